@@ -0,0 +1,640 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+// Throughput of every binarization method, run with e.g.
+//   imgproc_benchmarks --benchmark_out=result.json
+//                      --benchmark_out_format=json
+// and compare two runs with tools/benchmark-compare/compare.py.
+
+#include <cmath>   // std::sqrt
+#include <cstdint>
+#include <filesystem>   // temporary files
+#include <map>       // image cache
+#include <sstream>   // encoded output
+#include <string>    // image path
+#include <utility>   // std::pair
+#include <vector>    // swept params
+
+#include <benchmark/benchmark.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "benchmark/mat_allocation_counter.hpp"
+#include "imgproc/imgproc.hpp"
+
+namespace {
+  namespace imgproc = longlp::imgproc;
+
+  using longlp::benchmark::MatAllocationCounter;
+
+  enum class OutputFormat : int64_t {
+    kPng,
+    kPbm,
+    kTiffG4,
+  };
+
+  enum class ImageSource : int64_t {
+    kSynthetic,
+    kScan,
+  };
+
+  // A4 portrait aspect ratio
+  auto GetPageSize(const int64_t megapixels) -> cv::Size {
+    const auto area   = static_cast<double>(megapixels) * 1e6;
+    const auto height = std::sqrt(area * std::sqrt(2.0));
+    return {static_cast<int>(area / height), static_cast<int>(height)};
+  }
+
+  // Lines of dark strokes on an unevenly lit, noisy background, so that
+  // every method goes through both of its decisions
+  auto MakeSyntheticPage(const cv::Size& size) -> cv::Mat {
+    constexpr auto kLineHeight  = 48;
+    constexpr auto kGlyphHeight = 24;
+    constexpr auto kGlyphWidth  = 14;
+    constexpr auto kStrokeWidth = 3;
+
+    cv::Mat page{size, CV_8UC1};
+    cv::RNG rng{0x5EED};
+    for (auto y = 0; y < page.rows; ++y) {
+      auto* pixels = page.ptr<uint8_t>(y);
+
+      const auto line_y = y % kLineHeight;
+      const auto is_text_line =
+        line_y >= (kLineHeight - kGlyphHeight) / 2 &&
+        line_y < (kLineHeight + kGlyphHeight) / 2;
+
+      for (auto x = 0; x < page.cols; ++x) {
+        const auto glyph =
+          static_cast<uint32_t>(x / kGlyphWidth) * 2654435761U ^
+          static_cast<uint32_t>(y / kLineHeight);
+        const auto glyph_x = x % kGlyphWidth;
+        const auto is_stroke =
+          is_text_line && glyph % 5 != 0 &&
+          (glyph_x < kStrokeWidth ||
+           (glyph % 2 == 0 && line_y == kLineHeight / 2));
+
+        const auto illumination =
+          140.0 + 90.0 * (x + y) / static_cast<double>(page.cols + page.rows);
+        const auto value = (is_stroke ? 0.35 * illumination : illumination) +
+                           rng.gaussian(8.0);
+
+        pixels[x] = cv::saturate_cast<uint8_t>(value);
+      }
+    }
+    return page;
+  }
+
+  auto GetImage(const ImageSource source, const int64_t megapixels)
+    -> const cv::Mat& {
+    static std::map<std::pair<ImageSource, int64_t>, cv::Mat> images;
+
+    auto& image = images[{source, megapixels}];
+    if (image.empty()) {
+      const auto size = GetPageSize(megapixels);
+      if (source == ImageSource::kSynthetic) {
+        image = MakeSyntheticPage(size);
+      }
+      else if (const auto scan =
+                 cv::imread(std::string{LONGLP_BENCHMARK_DATA_DIR} + "/2.png",
+                            cv::ImreadModes::IMREAD_GRAYSCALE);
+               !scan.empty()) {
+        cv::resize(scan,
+                   image,
+                   size,
+                   0,
+                   0,
+                   cv::InterpolationFlags::INTER_LINEAR);
+      }
+    }
+    return image;
+  }
+
+  template <class MethodType>
+  auto MakeParams(const cv::Mat& input, int kernel_size) ->
+    typename MethodType::Params;
+
+  template <>
+  auto MakeParams<imgproc::Bernsen>([[maybe_unused]] const cv::Mat& input,
+                                    const int kernel_size)
+    -> imgproc::Bernsen::Params {
+    return {25.0 /* contrast limit */,
+            100.0 /* global threshold */,
+            cv::getStructuringElement(cv::MorphShapes::MORPH_ELLIPSE,
+                                      cv::Size{kernel_size, kernel_size})};
+  }
+
+  template <>
+  auto MakeParams<imgproc::NiBlack>([[maybe_unused]] const cv::Mat& input,
+                                    const int kernel_size)
+    -> imgproc::NiBlack::Params {
+    return {cv::Size{kernel_size, kernel_size}, -0.2 /* k */};
+  }
+
+  template <>
+  auto MakeParams<imgproc::Sauvola>([[maybe_unused]] const cv::Mat& input,
+                                    const int kernel_size)
+    -> imgproc::Sauvola::Params {
+    return {cv::Size{kernel_size, kernel_size}, 0.2 /* k */, 128.0 /* r */};
+  }
+
+  template <>
+  auto MakeParams<imgproc::Otsu2D>([[maybe_unused]] const cv::Mat& input,
+                                   const int kernel_size)
+    -> imgproc::Otsu2D::Params {
+    return {cv::Size{kernel_size, kernel_size},
+            false /* edge is foreground */,
+            true /* noise is background */,
+            cv::Mat{} /* average image, built internally */};
+  }
+
+  // Arguments: image source, megapixels, kernel size, background is white,
+  // fast execution mode
+  template <imgproc::BinarizationMethodInterface MethodType>
+  void BM_Binarize(benchmark::State& state) {
+    const auto source     = static_cast<ImageSource>(state.range(0));
+    const auto megapixels = state.range(1);
+    const auto kernel     = static_cast<int>(state.range(2));
+    const auto use_background_white_color = state.range(3) != 0;
+    const auto execution_mode = state.range(4) != 0
+                                ? imgproc::ExecutionMode::kFast
+                                : imgproc::ExecutionMode::kReference;
+
+    const auto& input = GetImage(source, megapixels);
+    if (input.empty()) {
+      state.SkipWithError("missing input image");
+      return;
+    }
+    state.SetLabel(source == ImageSource::kSynthetic ? "synthetic" : "scan");
+
+    const auto params = MakeParams<MethodType>(input, kernel);
+    const imgproc::BinarizationAlgorithm<MethodType> algorithm{
+      execution_mode};
+
+    MatAllocationCounter allocation_counter;
+    cv::Mat::setDefaultAllocator(&allocation_counter);
+
+    for ([[maybe_unused]] auto _ : state) {
+      cv::Mat output;
+      algorithm.Binarize(input, output, use_background_white_color, params);
+      benchmark::DoNotOptimize(output.data);
+      benchmark::ClobberMemory();
+    }
+
+    cv::Mat::setDefaultAllocator(nullptr);
+
+    const auto pixels = static_cast<double>(input.total()) *
+                        static_cast<double>(state.iterations());
+    state.counters["pixels_per_second"] =
+      benchmark::Counter(pixels, benchmark::Counter::kIsRate);
+    state.counters["bytes_allocated"] =
+      benchmark::Counter(static_cast<double>(
+                           allocation_counter.allocated_bytes()),
+                         benchmark::Counter::kAvgIterations,
+                         benchmark::Counter::kIs1024);
+    state.counters["allocations"] =
+      benchmark::Counter(static_cast<double>(
+                           allocation_counter.allocation_count()),
+                         benchmark::Counter::kAvgIterations);
+  }
+
+  // Approximate local thresholds against the exact kFast output of the
+  // same image, the "disagreement" counter is the fraction of pixels whose
+  // color differs. A stride of 1 runs the exact path, as a baseline.
+  // Arguments: image source, megapixels, kernel size, grid stride
+  template <imgproc::BinarizationMethodInterface MethodType>
+  void BM_BinarizeApproximate(benchmark::State& state) {
+    const auto source      = static_cast<ImageSource>(state.range(0));
+    const auto megapixels  = state.range(1);
+    const auto kernel      = static_cast<int>(state.range(2));
+    const auto grid_stride = static_cast<int>(state.range(3));
+
+    const auto& input = GetImage(source, megapixels);
+    if (input.empty()) {
+      state.SkipWithError("missing input image");
+      return;
+    }
+    state.SetLabel(source == ImageSource::kSynthetic ? "synthetic" : "scan");
+
+    const auto params = MakeParams<MethodType>(input, kernel);
+    const imgproc::BinarizationAlgorithm<MethodType> exact{
+      imgproc::ExecutionMode::kFast};
+    const imgproc::BinarizationAlgorithm<MethodType> approximate{
+      imgproc::ExecutionMode::kFast,
+      grid_stride};
+
+    imgproc::BinarizationWorkspace workspace;
+    cv::Mat output;
+    for ([[maybe_unused]] auto _ : state) {
+      approximate.Binarize(input, output, true, params, workspace);
+      benchmark::DoNotOptimize(output.data);
+      benchmark::ClobberMemory();
+    }
+
+    cv::Mat expected;
+    exact.Binarize(input, expected, true, params, workspace);
+    cv::Mat differences;
+    cv::compare(output, expected, differences, cv::CmpTypes::CMP_NE);
+
+    const auto pixels = static_cast<double>(input.total()) *
+                        static_cast<double>(state.iterations());
+    state.counters["pixels_per_second"] =
+      benchmark::Counter(pixels, benchmark::Counter::kIsRate);
+    state.counters["disagreement"] =
+      static_cast<double>(cv::countNonZero(differences)) /
+      static_cast<double>(input.total());
+  }
+
+  // First stage of the threshold map API. Arguments: image source,
+  // megapixels, kernel size, 32-bit float map
+  template <imgproc::BinarizationMethodInterface MethodType>
+  void BM_ComputeThresholdMap(benchmark::State& state) {
+    const auto source     = static_cast<ImageSource>(state.range(0));
+    const auto megapixels = state.range(1);
+    const auto kernel     = static_cast<int>(state.range(2));
+    const auto map_type   = state.range(3) != 0 ? CV_32FC1 : CV_8UC1;
+
+    const auto& input = GetImage(source, megapixels);
+    if (input.empty()) {
+      state.SkipWithError("missing input image");
+      return;
+    }
+    state.SetLabel(source == ImageSource::kSynthetic ? "synthetic" : "scan");
+
+    const auto params = MakeParams<MethodType>(input, kernel);
+    const imgproc::BinarizationAlgorithm<MethodType> algorithm{
+      imgproc::ExecutionMode::kFast};
+
+    imgproc::BinarizationWorkspace workspace;
+    cv::Mat map;
+    for ([[maybe_unused]] auto _ : state) {
+      algorithm.ComputeThresholdMap(input, map, map_type, params, workspace);
+      benchmark::DoNotOptimize(map.data);
+      benchmark::ClobberMemory();
+    }
+
+    const auto pixels = static_cast<double>(input.total()) *
+                        static_cast<double>(state.iterations());
+    state.counters["pixels_per_second"] =
+      benchmark::Counter(pixels, benchmark::Counter::kIsRate);
+  }
+
+  // Second stage of the threshold map API, on a Sauvola map. Arguments:
+  // image source, megapixels, 32-bit float map, background is white
+  void BM_ApplyThresholdMap(benchmark::State& state) {
+    const auto source     = static_cast<ImageSource>(state.range(0));
+    const auto megapixels = state.range(1);
+    const auto map_type   = state.range(2) != 0 ? CV_32FC1 : CV_8UC1;
+    const auto use_background_white_color = state.range(3) != 0;
+
+    const auto& input = GetImage(source, megapixels);
+    if (input.empty()) {
+      state.SkipWithError("missing input image");
+      return;
+    }
+    state.SetLabel(source == ImageSource::kSynthetic ? "synthetic" : "scan");
+
+    cv::Mat map;
+    const imgproc::BinarizationAlgorithm<imgproc::Sauvola> algorithm{
+      imgproc::ExecutionMode::kFast};
+    algorithm.ComputeThresholdMap(input,
+                                  map,
+                                  map_type,
+                                  MakeParams<imgproc::Sauvola>(input, 31));
+
+    cv::Mat output;
+    for ([[maybe_unused]] auto _ : state) {
+      imgproc::ApplyThresholdMap(input,
+                                 map,
+                                 output,
+                                 use_background_white_color);
+      benchmark::DoNotOptimize(output.data);
+      benchmark::ClobberMemory();
+    }
+
+    const auto pixels = static_cast<double>(input.total()) *
+                        static_cast<double>(state.iterations());
+    state.counters["pixels_per_second"] =
+      benchmark::Counter(pixels, benchmark::Counter::kIsRate);
+  }
+
+  // Parameter sweep of NiBlack or Sauvola, against one Binarize per params
+  // as a baseline. Arguments: image source, megapixels, kernel size, number
+  // of params, sweep.
+  template <imgproc::ParameterSweepMethodInterface MethodType>
+  void BM_ScoreSweep(benchmark::State& state) {
+    const auto source     = static_cast<ImageSource>(state.range(0));
+    const auto megapixels = state.range(1);
+    const auto kernel     = static_cast<int>(state.range(2));
+    const auto count      = static_cast<size_t>(state.range(3));
+    const auto sweep      = state.range(4) != 0;
+
+    const auto& input = GetImage(source, megapixels);
+    if (input.empty()) {
+      state.SkipWithError("missing input image");
+      return;
+    }
+    state.SetLabel(source == ImageSource::kSynthetic ? "synthetic" : "scan");
+
+    // k of MakeParams scaled from 1 / count to 2 times
+    std::vector<typename MethodType::Params> params(
+      count,
+      MakeParams<MethodType>(input, kernel));
+    for (size_t i = 0; i < count; ++i) {
+      params[i].k *= 2.0 * static_cast<double>(i + 1) /
+                     static_cast<double>(count);
+    }
+
+    const imgproc::BinarizationAlgorithm<MethodType> algorithm{
+      imgproc::ExecutionMode::kFast};
+
+    imgproc::BinarizationWorkspace workspace;
+    cv::Mat output;
+    for ([[maybe_unused]] auto _ : state) {
+      if (sweep) {
+        auto scores =
+          algorithm.ScoreSweep(input, cv::Mat{}, params, workspace);
+        benchmark::DoNotOptimize(scores.data());
+      }
+      else {
+        for (const auto& param : params) {
+          algorithm.Binarize(input, output, true, param, workspace);
+          auto background_pixels = cv::countNonZero(output);
+          benchmark::DoNotOptimize(background_pixels);
+        }
+      }
+      benchmark::ClobberMemory();
+    }
+
+    const auto pixels = static_cast<double>(input.total()) *
+                        static_cast<double>(count) *
+                        static_cast<double>(state.iterations());
+    state.counters["pixels_per_second"] =
+      benchmark::Counter(pixels, benchmark::Counter::kIsRate);
+  }
+
+  // Scoring of a Sauvola output of the scan against its ground truth, as
+  // during parameter tuning. Arguments: output already packed.
+  void BM_Evaluate(benchmark::State& state) {
+    const auto packed = state.range(0) != 0;
+
+    const auto input =
+      cv::imread(std::string{LONGLP_BENCHMARK_DATA_DIR} + "/2.bmp",
+                 cv::ImreadModes::IMREAD_GRAYSCALE);
+    const auto ground_truth =
+      cv::imread(std::string{LONGLP_BENCHMARK_GROUND_TRUTH_DIR} + "/2_gt.bmp",
+                 cv::ImreadModes::IMREAD_GRAYSCALE);
+    if (input.empty() || ground_truth.empty()) {
+      state.SkipWithError("missing input or ground truth image");
+      return;
+    }
+
+    cv::Mat output;
+    const imgproc::BinarizationAlgorithm<imgproc::Sauvola> algorithm{
+      imgproc::ExecutionMode::kFast};
+    algorithm.Binarize(input,
+                       output,
+                       true,
+                       MakeParams<imgproc::Sauvola>(input, 31));
+
+    const imgproc::BinarizationEvaluator evaluator{ground_truth};
+    const imgproc::PackedBinaryImage packed_output{output};
+
+    imgproc::BinarizationScores scores{};
+    for ([[maybe_unused]] auto _ : state) {
+      scores = packed ? evaluator.Evaluate(packed_output)
+                      : evaluator.Evaluate(output);
+      benchmark::DoNotOptimize(scores);
+    }
+
+    state.counters["evaluations_per_second"] = benchmark::Counter(
+      static_cast<double>(state.iterations()),
+      benchmark::Counter::kIsRate);
+    state.counters["f_measure"] = scores.f_measure;
+    state.counters["drd"]       = scores.drd;
+  }
+
+  // Binarization of a scan followed by the encoding of its output: the
+  // 8-bit image through PNG, or the packed rows through PBM and TIFF G4
+  void BM_WriteOutput(benchmark::State& state) {
+    const auto format     = static_cast<OutputFormat>(state.range(0));
+    const auto megapixels = state.range(1);
+
+    const auto& input = GetImage(ImageSource::kScan, megapixels);
+    if (input.empty()) {
+      state.SkipWithError("missing scan image");
+      return;
+    }
+
+    const imgproc::BinarizationAlgorithm<imgproc::Sauvola> algorithm{
+      imgproc::ExecutionMode::kFast};
+    const auto params = MakeParams<imgproc::Sauvola>(input, 31);
+
+    imgproc::BinarizationWorkspace workspace;
+    cv::Mat output;
+    imgproc::PackedBinaryImage packed_output;
+    std::vector<uint8_t> encoded;
+    size_t encoded_size = 0;
+
+    for ([[maybe_unused]] auto _ : state) {
+      if (format == OutputFormat::kPng) {
+        algorithm.Binarize(input, output, true, params, workspace);
+        cv::imencode(".png", output, encoded);
+        encoded_size = encoded.size();
+        continue;
+      }
+
+      algorithm.BinarizePacked(input, packed_output, true, params, workspace);
+
+      std::ostringstream stream;
+      if (format == OutputFormat::kPbm) {
+        imgproc::PbmWriter{stream, input.size()}.Write(packed_output);
+      }
+      else {
+        imgproc::TiffG4Writer writer{stream, input.size()};
+        writer.Write(packed_output);
+        writer.Finish();
+      }
+      encoded_size = stream.view().size();
+    }
+
+    state.SetItemsProcessed(state.iterations() *
+                            static_cast<int64_t>(input.total()));
+    state.counters["encoded_bytes"] = static_cast<double>(encoded_size);
+  }
+
+  // A PGM page read, binarized and written back: decoded by cv::imread and
+  // encoded by cv::imwrite, or read and written in place through memory
+  // mappings. Arguments: mapped, megapixels
+  void BM_PgmRoundTrip(benchmark::State& state) {
+    const auto mapped     = state.range(0) != 0;
+    const auto megapixels = state.range(1);
+
+    const auto& page = GetImage(ImageSource::kScan, megapixels);
+    if (page.empty()) {
+      state.SkipWithError("missing scan image");
+      return;
+    }
+
+    const auto directory = std::filesystem::temp_directory_path();
+    const auto input_path =
+      (directory / "imgproc_benchmark_input.pgm").string();
+    const auto output_path =
+      (directory / "imgproc_benchmark_output.pgm").string();
+    cv::imwrite(input_path, page);
+
+    const imgproc::BinarizationAlgorithm<imgproc::Sauvola> algorithm{
+      imgproc::ExecutionMode::kFast};
+    const auto params = MakeParams<imgproc::Sauvola>(page, 31);
+    imgproc::BinarizationWorkspace workspace;
+
+    for ([[maybe_unused]] auto _ : state) {
+      if (mapped) {
+        const imgproc::MappedImageReader reader{input_path};
+        imgproc::MappedImageWriter writer{output_path,
+                                          reader.image().size()};
+        algorithm.Binarize(reader.image(),
+                           writer.image(),
+                           true,
+                           params,
+                           workspace);
+      }
+      else {
+        const auto input =
+          cv::imread(input_path, cv::ImreadModes::IMREAD_GRAYSCALE);
+        cv::Mat output;
+        algorithm.Binarize(input, output, true, params, workspace);
+        cv::imwrite(output_path, output);
+      }
+    }
+
+    std::filesystem::remove(input_path);
+    std::filesystem::remove(output_path);
+
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(page.total()));
+  }
+
+  void LocalMethodArguments(benchmark::internal::Benchmark* benchmark) {
+    benchmark
+      ->ArgsProduct({{static_cast<int64_t>(ImageSource::kSynthetic),
+                      static_cast<int64_t>(ImageSource::kScan)},
+                     {1, 4, 16, 64},
+                     {15, 31, 75, 151},
+                     {0, 1},
+                     {0, 1}})
+      ->ArgNames({"source", "megapixels", "kernel", "white", "fast"})
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  }
+
+  void ApproximateArguments(benchmark::internal::Benchmark* benchmark) {
+    benchmark
+      ->ArgsProduct({{static_cast<int64_t>(ImageSource::kScan)},
+                     {4, 16},
+                     {31, 75},
+                     {1, 2, 4, 8}})
+      ->ArgNames({"source", "megapixels", "kernel", "stride"})
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  }
+
+  void ComputeThresholdMapArguments(benchmark::internal::Benchmark* benchmark) {
+    benchmark
+      ->ArgsProduct({{static_cast<int64_t>(ImageSource::kSynthetic),
+                      static_cast<int64_t>(ImageSource::kScan)},
+                     {4, 16},
+                     {31, 75},
+                     {0, 1}})
+      ->ArgNames({"source", "megapixels", "kernel", "float"})
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  }
+
+  void ApplyThresholdMapArguments(benchmark::internal::Benchmark* benchmark) {
+    benchmark
+      ->ArgsProduct({{static_cast<int64_t>(ImageSource::kSynthetic),
+                      static_cast<int64_t>(ImageSource::kScan)},
+                     {4, 16},
+                     {0, 1},
+                     {0, 1}})
+      ->ArgNames({"source", "megapixels", "float", "white"})
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  }
+
+  void ScoreSweepArguments(benchmark::internal::Benchmark* benchmark) {
+    benchmark
+      ->ArgsProduct({{static_cast<int64_t>(ImageSource::kScan)},
+                     {4, 16},
+                     {31, 75},
+                     {8, 50},
+                     {0, 1}})
+      ->ArgNames({"source", "megapixels", "kernel", "params", "sweep"})
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  }
+
+  // Otsu2D has a single execution mode
+  void GlobalMethodArguments(benchmark::internal::Benchmark* benchmark) {
+    benchmark
+      ->ArgsProduct({{static_cast<int64_t>(ImageSource::kSynthetic),
+                      static_cast<int64_t>(ImageSource::kScan)},
+                     {1, 4, 16, 64},
+                     {15, 31, 75, 151},
+                     {0, 1},
+                     {0}})
+      ->ArgNames({"source", "megapixels", "kernel", "white", "fast"})
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  }
+}   // namespace
+
+BENCHMARK_TEMPLATE(BM_Binarize, imgproc::Bernsen)->Apply(LocalMethodArguments);
+BENCHMARK_TEMPLATE(BM_Binarize, imgproc::NiBlack)->Apply(LocalMethodArguments);
+BENCHMARK_TEMPLATE(BM_Binarize, imgproc::Sauvola)->Apply(LocalMethodArguments);
+BENCHMARK_TEMPLATE(BM_Binarize, imgproc::Otsu2D)->Apply(GlobalMethodArguments);
+
+BENCHMARK_TEMPLATE(BM_BinarizeApproximate, imgproc::Bernsen)
+  ->Apply(ApproximateArguments);
+BENCHMARK_TEMPLATE(BM_BinarizeApproximate, imgproc::NiBlack)
+  ->Apply(ApproximateArguments);
+BENCHMARK_TEMPLATE(BM_BinarizeApproximate, imgproc::Sauvola)
+  ->Apply(ApproximateArguments);
+
+BENCHMARK_TEMPLATE(BM_ComputeThresholdMap, imgproc::Bernsen)
+  ->Apply(ComputeThresholdMapArguments);
+BENCHMARK_TEMPLATE(BM_ComputeThresholdMap, imgproc::NiBlack)
+  ->Apply(ComputeThresholdMapArguments);
+BENCHMARK_TEMPLATE(BM_ComputeThresholdMap, imgproc::Sauvola)
+  ->Apply(ComputeThresholdMapArguments);
+BENCHMARK(BM_ApplyThresholdMap)->Apply(ApplyThresholdMapArguments);
+
+BENCHMARK(BM_Evaluate)
+  ->ArgNames({"packed"})
+  ->DenseRange(0, 1)
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_WriteOutput)
+  ->ArgsProduct({{static_cast<int64_t>(OutputFormat::kPng),
+                  static_cast<int64_t>(OutputFormat::kPbm),
+                  static_cast<int64_t>(OutputFormat::kTiffG4)},
+                 {4, 16}})
+  ->ArgNames({"format", "megapixels"})
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_PgmRoundTrip)
+  ->ArgsProduct({{0, 1}, {4, 16}})
+  ->ArgNames({"mapped", "megapixels"})
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_ScoreSweep, imgproc::NiBlack)
+  ->Apply(ScoreSweepArguments);
+BENCHMARK_TEMPLATE(BM_ScoreSweep, imgproc::Sauvola)
+  ->Apply(ScoreSweepArguments);
+
+BENCHMARK_MAIN();
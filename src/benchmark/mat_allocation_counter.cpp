@@ -0,0 +1,39 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "benchmark/mat_allocation_counter.hpp"
+
+namespace {
+  using longlp::benchmark::MatAllocationCounter;
+}   // namespace
+
+auto MatAllocationCounter::allocate(const int dims,
+                                    const int* sizes,
+                                    const int type,
+                                    void* data,
+                                    size_t* step,
+                                    const cv::AccessFlag flags,
+                                    const cv::UMatUsageFlags usage_flags) const
+  -> cv::UMatData* {
+  auto* mat_data =
+    allocator_->allocate(dims, sizes, type, data, step, flags, usage_flags);
+
+  // user data is only wrapped, not allocated
+  if (data == nullptr && mat_data != nullptr) {
+    allocated_bytes_.fetch_add(mat_data->size, std::memory_order_relaxed);
+    allocation_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return mat_data;
+}
+
+auto MatAllocationCounter::allocate(cv::UMatData* data,
+                                    const cv::AccessFlag access_flags,
+                                    const cv::UMatUsageFlags usage_flags) const
+  -> bool {
+  return allocator_->allocate(data, access_flags, usage_flags);
+}
+
+void MatAllocationCounter::deallocate(cv::UMatData* data) const {
+  allocator_->deallocate(data);
+}
@@ -0,0 +1,53 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef BENCHMARK_MAT_ALLOCATION_COUNTER_HPP_
+#define BENCHMARK_MAT_ALLOCATION_COUNTER_HPP_
+
+#include <atomic>
+#include <cstddef>
+
+#include <opencv2/core.hpp>
+
+namespace longlp::benchmark {
+
+  // cv::MatAllocator counting the bytes allocated for cv::Mat data, every
+  // other call is forwarded to the standard allocator of OpenCV
+  class MatAllocationCounter final : public cv::MatAllocator {
+   public:
+    MatAllocationCounter() = default;
+
+    auto allocate(int dims,
+                  const int* sizes,
+                  int type,
+                  void* data,
+                  size_t* step,
+                  cv::AccessFlag flags,
+                  cv::UMatUsageFlags usage_flags) const
+      -> cv::UMatData* override;
+
+    auto allocate(cv::UMatData* data,
+                  cv::AccessFlag access_flags,
+                  cv::UMatUsageFlags usage_flags) const -> bool override;
+
+    void deallocate(cv::UMatData* data) const override;
+
+    [[nodiscard]] auto allocated_bytes() const noexcept -> size_t {
+      return allocated_bytes_.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto allocation_count() const noexcept -> size_t {
+      return allocation_count_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    const cv::MatAllocator* allocator_ = cv::Mat::getStdAllocator();
+
+    mutable std::atomic<size_t> allocated_bytes_{0};
+    mutable std::atomic<size_t> allocation_count_{0};
+  };
+
+}   // namespace longlp::benchmark
+
+#endif   // BENCHMARK_MAT_ALLOCATION_COUNTER_HPP_
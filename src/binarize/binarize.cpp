@@ -0,0 +1,573 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+// Binarizes a batch of pages without any window, e.g.
+//   binarize --method=sauvola --kernel=31 --format=tiff --output=out scans
+// Pages go through three stages, decode -> binarize -> encode, each run by
+// its own workers and connected by bounded queues, so that disk I/O, codec
+// work and thresholding overlap. The throughput of every stage is printed
+// at the end.
+
+#include <algorithm>   // std::sort
+#include <atomic>
+#include <cctype>   // std::tolower
+#include <chrono>
+#include <cstdint>
+#include <cstdio>       // stderr
+#include <filesystem>
+#include <fstream>      // manifest, stats
+#include <mutex>        // error reports
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "binarize/bounded_queue.hpp"
+#include "imgproc/imgproc.hpp"
+
+namespace {
+  namespace imgproc = longlp::imgproc;
+  namespace fs      = std::filesystem;
+
+  using longlp::binarize::BoundedQueue;
+
+  using Clock = std::chrono::steady_clock;
+
+  constexpr auto kKeys =
+    "{help h ?           |         | print this message}"
+    "{@input             |         | input directory, glob pattern, or "
+    "manifest (.txt, one path per line)}"
+    "{output o           |         | output directory}"
+    "{method m           | sauvola | bernsen, niblack, sauvola or otsu}"
+    "{format f           | png     | output format: png, pgm, pbm or tiff "
+    "(CCITT G4)}"
+    "{kernel             | 31      | kernel size}"
+    "{k                  |         | k of niblack (default -0.2) and "
+    "sauvola (default 0.2)}"
+    "{r                  | 128     | dynamic range of the standard "
+    "deviation of sauvola}"
+    "{contrast-limit     | 25      | contrast limit of bernsen}"
+    "{global-threshold   | 100     | global threshold of bernsen}"
+    "{edge-as-background | false   | otsu treats the detected edges as "
+    "background}"
+    "{noise-as-foreground| false   | otsu treats the detected noise as "
+    "foreground}"
+    "{black-background   | false   | write the background black}"
+    "{reference          | false   | bit-exact reference arithmetic "
+    "instead of the fast one}"
+    "{decoders           | 2       | decode workers}"
+    "{binarizers         | 2       | binarize workers}"
+    "{encoders           | 2       | encode workers}"
+    "{queue              | 4       | pages held by each queue}"
+    "{threads            | -1      | threads of each binarization, the "
+    "OpenCV default when negative}"
+    "{stats              |         | JSON file of the stages of the "
+    "binarizations, built with LONGLP_IMGPROC_INSTRUMENTATION}";
+
+  enum class OutputFormat : uint8_t {
+    kPng,
+    kPgm,
+    kPbm,
+    kTiffG4,
+  };
+
+  struct Options {
+    std::vector<std::string> inputs;
+    fs::path output_directory;
+    OutputFormat format{};
+    bool use_background_white_color{};
+    imgproc::ExecutionMode execution_mode{};
+    size_t decoders{};
+    size_t binarizers{};
+    size_t encoders{};
+    size_t queue_capacity{};
+
+    // empty when the stages of the binarizations are not written
+    std::string stats_path;
+  };
+
+  struct DecodedPage {
+    size_t index;
+    cv::Mat image;
+
+    // keeps the pixels of |image| mapped, for PGM inputs
+    std::optional<imgproc::MappedImageReader> mapping;
+  };
+
+  struct BinarizedPage {
+    size_t index;
+    uint64_t pixels;
+
+    // one of them holds the output, depending on the output format
+    cv::Mat output;
+    imgproc::PackedBinaryImage packed_output;
+    std::optional<imgproc::MappedImageWriter> mapping;
+  };
+
+  // Work done by the workers of one stage, the time waiting on the queues
+  // is not counted
+  struct StageStats {
+    std::atomic<size_t> pages{0};
+    std::atomic<uint64_t> pixels{0};
+    std::atomic<int64_t> busy_nanoseconds{0};
+
+    void Add(const uint64_t page_pixels, const Clock::time_point start) {
+      pages.fetch_add(1, std::memory_order_relaxed);
+      pixels.fetch_add(page_pixels, std::memory_order_relaxed);
+      busy_nanoseconds.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start)
+          .count(),
+        std::memory_order_relaxed);
+    }
+  };
+
+  // Failed pages are reported and skipped, the other pages go on
+  class ErrorReporter {
+   public:
+    void Report(const std::string& path, const char* stage, const char* what) {
+      const std::scoped_lock lock{mutex_};
+      fmt::print(stderr, "{}: {} failed: {}\n", path, stage, what);
+      ++count_;
+    }
+
+    [[nodiscard]] auto count() const noexcept -> size_t {
+      return count_;
+    }
+
+   private:
+    std::mutex mutex_;
+    size_t count_{0};
+  };
+
+  auto ParseFormat(const std::string& name) -> OutputFormat {
+    if (name == "png") {
+      return OutputFormat::kPng;
+    }
+    if (name == "pgm") {
+      return OutputFormat::kPgm;
+    }
+    if (name == "pbm") {
+      return OutputFormat::kPbm;
+    }
+    if (name == "tiff" || name == "tif") {
+      return OutputFormat::kTiffG4;
+    }
+    CV_Error(cv::Error::Code::StsBadArg,
+             fmt::format("unknown output format {}", name));
+  }
+
+  auto GetExtension(const OutputFormat format) -> const char* {
+    switch (format) {
+      case OutputFormat::kPng:
+        return ".png";
+      case OutputFormat::kPgm:
+        return ".pgm";
+      case OutputFormat::kPbm:
+        return ".pbm";
+      case OutputFormat::kTiffG4:
+        return ".tif";
+    }
+    return "";
+  }
+
+  auto IsImagePath(const fs::path& path) -> bool {
+    auto extension = path.extension().string();
+    std::transform(extension.begin(),
+                   extension.end(),
+                   extension.begin(),
+                   [](const unsigned char c) {
+                     return static_cast<char>(std::tolower(c));
+                   });
+    return extension == ".pgm" || extension == ".pnm" ||
+           extension == ".png" || extension == ".bmp" ||
+           extension == ".tif" || extension == ".tiff" ||
+           extension == ".jpg" || extension == ".jpeg";
+  }
+
+  // Images of a directory, lines of a manifest, or matches of a pattern
+  auto ListInputs(const std::string& input) -> std::vector<std::string> {
+    std::vector<std::string> paths;
+    if (fs::is_directory(input)) {
+      for (const auto& entry : fs::directory_iterator{input}) {
+        if (entry.is_regular_file() && IsImagePath(entry.path())) {
+          paths.push_back(entry.path().string());
+        }
+      }
+    }
+    else if (fs::is_regular_file(input) &&
+             fs::path{input}.extension() == ".txt") {
+      std::ifstream manifest{input};
+      for (std::string line; std::getline(manifest, line);) {
+        if (!line.empty() && line.front() != '#') {
+          paths.push_back(line);
+        }
+      }
+    }
+    else {
+      std::vector<cv::String> matches;
+      cv::glob(input, matches, false);
+      paths.assign(matches.begin(), matches.end());
+    }
+
+    std::sort(paths.begin(), paths.end());
+    return paths;
+  }
+
+  auto GetOutputPath(const Options& options, const size_t index)
+    -> std::string {
+    auto name = fs::path{options.inputs[index]}.stem();
+    name += GetExtension(options.format);
+    return (options.output_directory / name).string();
+  }
+
+  auto Decode(const std::string& path) -> DecodedPage {
+    DecodedPage page{};
+
+    // uncompressed 8-bit PGM pages are read in place, other ones decoded
+    if (fs::path{path}.extension() == ".pgm") {
+      try {
+        page.mapping.emplace(path);
+        page.image = page.mapping->image();
+        return page;
+      }
+      catch (const cv::Exception&) {
+        page.mapping.reset();
+      }
+    }
+
+    page.image = cv::imread(path, cv::ImreadModes::IMREAD_GRAYSCALE);
+    if (page.image.empty()) {
+      CV_Error(cv::Error::Code::StsError, "cannot read the image");
+    }
+    return page;
+  }
+
+  template <imgproc::BinarizationMethodInterface MethodType>
+  auto Binarize(const imgproc::BinarizationAlgorithm<MethodType>& algorithm,
+                const typename MethodType::Params& params,
+                const Options& options,
+                const DecodedPage& page,
+                imgproc::BinarizationWorkspace& workspace) -> BinarizedPage {
+    BinarizedPage binarized{};
+    binarized.index  = page.index;
+    binarized.pixels = page.image.total();
+
+    const auto white = options.use_background_white_color;
+    switch (options.format) {
+      case OutputFormat::kPbm:
+      case OutputFormat::kTiffG4:
+        algorithm.BinarizePacked(page.image,
+                                 binarized.packed_output,
+                                 white,
+                                 params,
+                                 workspace);
+        break;
+      case OutputFormat::kPgm:
+        // written in place into the mapped output file
+        binarized.mapping.emplace(GetOutputPath(options, page.index),
+                                  page.image.size());
+        algorithm.Binarize(page.image,
+                           binarized.mapping->image(),
+                           white,
+                           params,
+                           workspace);
+        if (!binarized.mapping->is_mapped()) {
+          CV_Error(cv::Error::Code::StsInternal,
+                   "output was reallocated out of the mapped file");
+        }
+        break;
+      case OutputFormat::kPng:
+        algorithm.Binarize(page.image,
+                           binarized.output,
+                           white,
+                           params,
+                           workspace);
+        break;
+    }
+    return binarized;
+  }
+
+  void Encode(const Options& options, BinarizedPage& page) {
+    const auto path = GetOutputPath(options, page.index);
+    switch (options.format) {
+      case OutputFormat::kPbm:
+        imgproc::WritePbm(path, page.packed_output);
+        break;
+      case OutputFormat::kTiffG4:
+        imgproc::WriteTiffG4(path, page.packed_output);
+        break;
+      case OutputFormat::kPgm:
+        // unmapped, the kernel writes the pages back
+        page.mapping.reset();
+        break;
+      case OutputFormat::kPng:
+        if (!cv::imwrite(path,
+                         page.output,
+                         {cv::ImwriteFlags::IMWRITE_PNG_BILEVEL, 1})) {
+          CV_Error(cv::Error::Code::StsError, "cannot write the image");
+        }
+        break;
+    }
+  }
+
+  void PrintStats(const char* stage,
+                  const size_t workers,
+                  const StageStats& stats) {
+    const auto megapixels = static_cast<double>(stats.pixels.load()) * 1e-6;
+    const auto busy_seconds =
+      static_cast<double>(stats.busy_nanoseconds.load()) * 1e-9;
+
+    // rate sustained by the |workers| of the stage working in parallel
+    const auto throughput =
+      busy_seconds > 0.0
+        ? megapixels * static_cast<double>(workers) / busy_seconds
+        : 0.0;
+    fmt::print("{:<9} {:>7} {:>6} {:>11.2f} {:>13.3f} {:>12.2f}\n",
+               stage,
+               workers,
+               stats.pages.load(),
+               megapixels,
+               busy_seconds,
+               throughput);
+  }
+
+  template <imgproc::BinarizationMethodInterface MethodType>
+  auto RunPipeline(const Options& options,
+                   const typename MethodType::Params& params) -> int32_t {
+    const imgproc::BinarizationAlgorithm<MethodType> algorithm{
+      options.execution_mode};
+
+    BoundedQueue<DecodedPage> decoded_pages{options.queue_capacity};
+    BoundedQueue<BinarizedPage> binarized_pages{options.queue_capacity};
+
+    StageStats decode_stats;
+    StageStats binarize_stats;
+    StageStats encode_stats;
+    ErrorReporter errors;
+    std::atomic<size_t> next_input{0};
+
+    // stages of the binarizations, merged from every binarize worker
+    imgproc::BinarizationStats binarization_stats;
+    std::mutex binarization_stats_mutex;
+
+    const auto decode = [&options,
+                         &decoded_pages,
+                         &decode_stats,
+                         &errors,
+                         &next_input]() {
+      for (auto index = next_input.fetch_add(1);
+           index < options.inputs.size();
+           index = next_input.fetch_add(1)) {
+        const auto& path = options.inputs[index];
+        try {
+          const auto start = Clock::now();
+          auto page        = Decode(path);
+          page.index       = index;
+          decode_stats.Add(page.image.total(), start);
+          decoded_pages.Push(std::move(page));
+        }
+        catch (const std::exception& exception) {
+          errors.Report(path, "decode", exception.what());
+        }
+      }
+    };
+
+    const auto binarize = [&options,
+                           &algorithm,
+                           &params,
+                           &decoded_pages,
+                           &binarized_pages,
+                           &binarize_stats,
+                           &errors,
+                           &binarization_stats,
+                           &binarization_stats_mutex]() {
+      imgproc::BinarizationStats worker_stats;
+      imgproc::BinarizationWorkspace workspace;
+      workspace.set_stats(&worker_stats);
+
+      while (auto page = decoded_pages.Pop()) {
+        try {
+          const auto start = Clock::now();
+          auto binarized =
+            Binarize(algorithm, params, options, *page, workspace);
+          binarize_stats.Add(binarized.pixels, start);
+          binarized_pages.Push(std::move(binarized));
+        }
+        catch (const std::exception& exception) {
+          errors.Report(options.inputs[page->index],
+                        "binarize",
+                        exception.what());
+        }
+      }
+
+      const std::scoped_lock lock{binarization_stats_mutex};
+      binarization_stats.Merge(worker_stats);
+    };
+
+    const auto encode = [&options, &binarized_pages, &encode_stats, &errors]() {
+      while (auto page = binarized_pages.Pop()) {
+        try {
+          const auto start = Clock::now();
+          Encode(options, *page);
+          encode_stats.Add(page->pixels, start);
+        }
+        catch (const std::exception& exception) {
+          errors.Report(options.inputs[page->index],
+                        "encode",
+                        exception.what());
+        }
+      }
+    };
+
+    const auto start = Clock::now();
+    {
+      std::vector<std::jthread> decoders;
+      std::vector<std::jthread> binarizers;
+      std::vector<std::jthread> encoders;
+      for (size_t i = 0; i < options.decoders; ++i) {
+        decoders.emplace_back(decode);
+      }
+      for (size_t i = 0; i < options.binarizers; ++i) {
+        binarizers.emplace_back(binarize);
+      }
+      for (size_t i = 0; i < options.encoders; ++i) {
+        encoders.emplace_back(encode);
+      }
+
+      // each queue is closed once every producer of it is done
+      for (auto& decoder : decoders) {
+        decoder.join();
+      }
+      decoded_pages.Close();
+      for (auto& binarizer : binarizers) {
+        binarizer.join();
+      }
+      binarized_pages.Close();
+    }
+    const auto wall_seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+    fmt::print("{:<9} {:>7} {:>6} {:>11} {:>13} {:>12}\n",
+               "stage",
+               "workers",
+               "pages",
+               "megapixels",
+               "busy_seconds",
+               "megapixels/s");
+    PrintStats("decode", options.decoders, decode_stats);
+    PrintStats("binarize", options.binarizers, binarize_stats);
+    PrintStats("encode", options.encoders, encode_stats);
+    fmt::print("{} of {} pages in {:.3f} s, {:.2f} megapixels/s\n",
+               encode_stats.pages.load(),
+               options.inputs.size(),
+               wall_seconds,
+               static_cast<double>(encode_stats.pixels.load()) * 1e-6 /
+                 wall_seconds);
+
+    if (!options.stats_path.empty()) {
+      if (!imgproc::kInstrumentationEnabled) {
+        fmt::print(stderr,
+                   "stages are not timed without "
+                   "LONGLP_IMGPROC_INSTRUMENTATION\n");
+      }
+      std::ofstream{options.stats_path} << binarization_stats.ToJson() << '\n';
+    }
+
+    return errors.count() == 0 ? 0 : 1;
+  }
+
+  auto GetWorkerCount(const cv::CommandLineParser& parser, const char* key)
+    -> size_t {
+    const auto count = parser.get<int>(key);
+    if (count < 1) {
+      CV_Error(cv::Error::Code::StsBadArg,
+               fmt::format("--{} must be at least 1", key));
+    }
+    return static_cast<size_t>(count);
+  }
+}   // namespace
+
+auto main(const int argc, const char* argv[]) -> int32_t {
+  cv::CommandLineParser parser{argc, argv, kKeys};
+  parser.about("Headless batch binarization of document pages");
+  if (parser.has("help") || !parser.has("@input") || !parser.has("output")) {
+    parser.printMessage();
+    return parser.has("help") ? 0 : 2;
+  }
+
+  try {
+    Options options{};
+    options.inputs           = ListInputs(parser.get<std::string>("@input"));
+    options.output_directory = parser.get<std::string>("output");
+    options.format           = ParseFormat(parser.get<std::string>("format"));
+    options.use_background_white_color = !parser.get<bool>("black-background");
+    options.execution_mode = parser.get<bool>("reference")
+                             ? imgproc::ExecutionMode::kReference
+                             : imgproc::ExecutionMode::kFast;
+    options.decoders       = GetWorkerCount(parser, "decoders");
+    options.binarizers     = GetWorkerCount(parser, "binarizers");
+    options.encoders       = GetWorkerCount(parser, "encoders");
+    options.queue_capacity = GetWorkerCount(parser, "queue");
+    options.stats_path     = parser.get<std::string>("stats");
+    if (!parser.check()) {
+      parser.printErrors();
+      return 2;
+    }
+    if (options.inputs.empty()) {
+      fmt::print(stderr, "no input image\n");
+      return 2;
+    }
+    fs::create_directories(options.output_directory);
+    if (const auto threads = parser.get<int>("threads"); threads >= 0) {
+      cv::setNumThreads(threads);
+    }
+
+    const auto method      = parser.get<std::string>("method");
+    const auto kernel      = parser.get<int>("kernel");
+    const auto kernel_size = cv::Size{kernel, kernel};
+    if (method == "bernsen") {
+      return RunPipeline<imgproc::Bernsen>(
+        options,
+        {parser.get<double>("contrast-limit"),
+         parser.get<double>("global-threshold"),
+         cv::getStructuringElement(cv::MorphShapes::MORPH_ELLIPSE,
+                                   kernel_size)});
+    }
+    if (method == "niblack") {
+      return RunPipeline<imgproc::NiBlack>(
+        options,
+        {kernel_size, parser.has("k") ? parser.get<double>("k") : -0.2});
+    }
+    if (method == "sauvola") {
+      return RunPipeline<imgproc::Sauvola>(
+        options,
+        {kernel_size,
+         parser.has("k") ? parser.get<double>("k") : 0.2,
+         parser.get<double>("r")});
+    }
+    if (method == "otsu") {
+      return RunPipeline<imgproc::Otsu2D>(
+        options,
+        {kernel_size,
+         parser.get<bool>("edge-as-background"),
+         !parser.get<bool>("noise-as-foreground")});
+    }
+    fmt::print(stderr, "unknown method {}\n", method);
+    return 2;
+  }
+  catch (const cv::Exception& exception) {
+    fmt::print(stderr, "{}\n", exception.what());
+    return 1;
+  }
+  catch (const fs::filesystem_error& exception) {
+    fmt::print(stderr, "{}\n", exception.what());
+    return 1;
+  }
+}
@@ -0,0 +1,75 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef BINARIZE_BOUNDED_QUEUE_HPP_
+#define BINARIZE_BOUNDED_QUEUE_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>   // std::move
+
+namespace longlp::binarize {
+
+  // FIFO queue between two pipeline stages holding at most |capacity|
+  // items, so that a fast producer waits for its consumers instead of
+  // buffering whole decoded pages
+  template <class T>
+  class BoundedQueue {
+   public:
+    explicit BoundedQueue(const size_t capacity) :
+      capacity_{capacity > 0 ? capacity : 1} {}
+
+    // Waits for a free slot, the item is dropped when the queue is closed
+    void Push(T item) {
+      std::unique_lock lock{mutex_};
+      not_full_.wait(lock, [this]() {
+        return closed_ || items_.size() < capacity_;
+      });
+      if (closed_) {
+        return;
+      }
+      items_.push_back(std::move(item));
+      lock.unlock();
+      not_empty_.notify_one();
+    }
+
+    // Waits for an item, empty once the queue is closed and drained
+    auto Pop() -> std::optional<T> {
+      std::unique_lock lock{mutex_};
+      not_empty_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+      if (items_.empty()) {
+        return std::nullopt;
+      }
+      auto item = std::move(items_.front());
+      items_.pop_front();
+      lock.unlock();
+      not_full_.notify_one();
+      return item;
+    }
+
+    // No more items are pushed, the pending ones are still popped
+    void Close() {
+      {
+        const std::scoped_lock lock{mutex_};
+        closed_ = true;
+      }
+      not_empty_.notify_all();
+      not_full_.notify_all();
+    }
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<T> items_;
+    size_t capacity_;
+    bool closed_{false};
+  };
+
+}   // namespace longlp::binarize
+
+#endif   // BINARIZE_BOUNDED_QUEUE_HPP_
@@ -0,0 +1,61 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+// Scores binarized images against their ground truth, e.g.
+//   imgproc_evaluate data/ground-truth/2_gt.bmp output_1.png output_2.png
+// Object pixels are black in every image.
+
+#include <cstdint>
+#include <cstdio>   // stderr
+#include <span>
+
+#include <fmt/format.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "imgproc/imgproc.hpp"
+
+namespace {
+  namespace imgproc = longlp::imgproc;
+
+  auto ReadGrayscale(const char* path) -> cv::Mat {
+    auto image = cv::imread(path, cv::ImreadModes::IMREAD_GRAYSCALE);
+    if (image.empty()) {
+      CV_Error(cv::Error::Code::StsError,
+               fmt::format("cannot read image {}", path));
+    }
+    return image;
+  }
+}   // namespace
+
+auto main(const int argc, const char* argv[]) -> int32_t {
+  const std::span arguments{argv, static_cast<size_t>(argc)};
+  if (arguments.size() < 3) {
+    fmt::print(stderr,
+               "usage: {} <ground truth> <output>...\n",
+               arguments.front());
+    return 2;
+  }
+
+  try {
+    const imgproc::BinarizationEvaluator evaluator{
+      ReadGrayscale(arguments[1])};
+
+    fmt::print("output,f_measure,pseudo_f_measure,psnr,drd\n");
+    for (const auto* path : arguments.subspan(2)) {
+      const auto scores = evaluator.Evaluate(ReadGrayscale(path));
+      fmt::print("{},{:.4f},{:.4f},{:.4f},{:.4f}\n",
+                 path,
+                 scores.f_measure,
+                 scores.pseudo_f_measure,
+                 scores.psnr,
+                 scores.drd);
+    }
+  }
+  catch (const cv::Exception& exception) {
+    fmt::print(stderr, "{}\n", exception.what());
+    return 1;
+  }
+  return 0;
+}
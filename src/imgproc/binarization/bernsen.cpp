@@ -4,25 +4,373 @@
 
 #include "imgproc/binarization/bernsen.hpp"
 
+#include <algorithm>     // std::fill_n
+#include <cmath>         // std::ceil
+#include <cstddef>
+#include <cstdint>
+#include <functional>    // std::plus, std::minus
+#include <limits>
+#include <type_traits>   // std::is_integral_v
+
 #include <opencv2/core/softfloat.hpp>
 
+#include "imgproc/common/binarization_workspace.hpp"
+#include "imgproc/common/chungkwong_chan_integral_image_calculator.hpp"
 #include "imgproc/common/constant.hpp"
 #include "imgproc/common/integral_image_calculator.hpp"
+#include "imgproc/common/local_sums.hpp"
+#include "imgproc/common/min_max_filter.hpp"
+#include "imgproc/common/threshold_grid.hpp"
+#include "imgproc/common/threshold_map.hpp"
 
 namespace {
-  using longlp::imgproc::Bernsen;
+  using longlp::imgproc::BasicBernsen;
+  using longlp::imgproc::BinarizationStage;
+  using longlp::imgproc::BinarizationWorkspace;
   using longlp::imgproc::BinaryColorPair;
+  using longlp::imgproc::ChungkwongChanIntegralImageCalculator;
+  using longlp::imgproc::GetStripeCount;
+  using longlp::imgproc::GetStripeRows;
+  using longlp::imgproc::GrayscalePixel;
   using longlp::imgproc::IntegralImageCalculator;
-  using KernelVertices = IntegralImageCalculator::KernelVertices;
-  using IntegralImages = IntegralImageCalculator::IntegralImages<1>;
+  using longlp::imgproc::kBinaryColors;
+  using longlp::imgproc::kGrayscaleMax;
+  using longlp::imgproc::LocalSumsRows;
+  using longlp::imgproc::MinMaxFilter;
+  using longlp::imgproc::ScopedStageTimer;
+  using longlp::imgproc::ThresholdGrid;
+  using longlp::imgproc::ToThresholdMapValue;
+  using longlp::imgproc::WorkspaceSlot;
 
   using ErrorCode = cv::Error::Code;
   using cv::softdouble;
 
+  // local contrast = max - min, with cv::softdouble:
+  // - low contrast: the window is either all object or all background,
+  //   decided by comparing its mean to the global threshold
+  // - high contrast: the pixel is compared to the mean of its window
+  struct ReferenceDecision {
+    BinaryColorPair binary_colors;
+    softdouble N;
+    softdouble gt;
+    softdouble ct;
+
+    auto operator()(const GrayscalePixel pixel,
+                    const GrayscalePixel min,
+                    const GrayscalePixel max,
+                    const double sum) const -> GrayscalePixel {
+      const auto local_contrast = softdouble{max} - softdouble{min};
+
+      const auto mean = softdouble{sum} / N;
+
+      if (local_contrast < ct) {
+        return mean < gt ? binary_colors.object : binary_colors.background;
+      }
+      return softdouble{pixel} < mean ? binary_colors.object
+                                      : binary_colors.background;
+    }
+  };
+
+  // Same decision as ReferenceDecision with hardware doubles, instantiated
+  // per polarity. Both contrast cases compare a value to a limit, which are
+  // selected rather than branched on, so that the row loops vectorize.
+  template <bool UseBackgroundWhiteColor>
+  struct FastDecision {
+    double inverse_area;
+    double gt;
+    double ct;
+
+    auto operator()(const GrayscalePixel pixel,
+                    const GrayscalePixel min,
+                    const GrayscalePixel max,
+                    const double sum) const noexcept -> GrayscalePixel {
+      constexpr auto kColors = kBinaryColors<UseBackgroundWhiteColor>;
+
+      const auto mean            = sum * inverse_area;
+      const auto is_low_contrast = static_cast<double>(max - min) < ct;
+
+      const auto value = is_low_contrast ? mean : static_cast<double>(pixel);
+      const auto limit = is_low_contrast ? gt : mean;
+
+      return value < limit ? kColors.object : kColors.background;
+    }
+  };
+
+  // Same decision as FastDecision as a threshold above which pixels are
+  // background:
+  // - low contrast: above every pixel or below every pixel
+  // - high contrast: pixel >= mean <=> pixel > ceil(mean) - 1, pixels are
+  //   integers
+  auto ToThreshold(const double mean,
+                   const double local_contrast,
+                   const double gt,
+                   const double ct) noexcept -> double {
+    if (local_contrast < ct) {
+      return mean < gt ? static_cast<double>(kGrayscaleMax) : -1.0;
+    }
+    return std::ceil(mean) - 1.0;
+  }
+
+  // ToThreshold of the windows of ThresholdGrid
+  struct GridThreshold {
+    double gt;
+    double ct;
+
+    auto operator()(const ThresholdGrid::Window& window) const noexcept
+      -> double {
+      return ToThreshold(window.mean(),
+                         static_cast<double>(window.max - window.min),
+                         gt,
+                         ct);
+    }
+  };
+
+  // Same decision as FastDecision as a threshold map value
+  template <class MapValue>
+  struct MapThreshold {
+    double inverse_area;
+    double gt;
+    double ct;
+
+    auto operator()([[maybe_unused]] const GrayscalePixel pixel,
+                    const GrayscalePixel min,
+                    const GrayscalePixel max,
+                    const double sum) const noexcept -> MapValue {
+      const auto threshold = ToThreshold(sum * inverse_area,
+                                         static_cast<double>(max - min),
+                                         gt,
+                                         ct);
+      return ToThresholdMapValue<MapValue>(threshold);
+    }
+  };
+
+  // output[x] = decision(input[x], mins[x], maxs[x], sums[x])
+  template <class Decision>
+  void BinarizeRow(const GrayscalePixel* input,
+                   const GrayscalePixel* mins,
+                   const GrayscalePixel* maxs,
+                   const double* sums,
+                   GrayscalePixel* output,
+                   const size_t width,
+                   const Decision& decision) {
+    for (size_t x = 0; x < width; ++x) {
+      output[x] = decision(input[x], mins[x], maxs[x], sums[x]);
+    }
+  }
+
+  template <bool UseBackgroundWhiteColor, class Params>
+  auto MakeFastDecision(const Params& params) noexcept
+    -> FastDecision<UseBackgroundWhiteColor> {
+    return {1.0 / static_cast<double>(params.kernel.total()),
+            params.global_threshold,
+            params.contrast_limit};
+  }
+
+  template <class Params>
+  auto MakeReferenceDecision(const BinaryColorPair& binary_colors,
+                             const Params& params) -> ReferenceDecision {
+    return {binary_colors,
+            softdouble{params.kernel.total()},
+            softdouble{params.global_threshold},
+            softdouble{params.contrast_limit}};
+  }
+
+  // column_sums = operation(column_sums, I) for the row |y| of the input
+  // reflected at its edges
+  template <class Operation, class SumType>
+  void AccumulateColumnSums(const cv::Mat& input,
+                            const int y,
+                            SumType* column_sums) noexcept {
+    const auto* pixels = input.ptr<GrayscalePixel>(
+      cv::borderInterpolate(y, input.rows, cv::BorderTypes::BORDER_REFLECT));
+    for (size_t x = 0; x < static_cast<size_t>(input.cols); ++x) {
+      column_sums[x] =
+        Operation{}(column_sums[x], static_cast<SumType>(pixels[x]));
+    }
+  }
+
+  // The sums of SweepFused wrap around in unsigned 32-bit integers, which
+  // cancels out in the differences as long as the sum of one window fits
+  template <class Params>
+  auto FitsUInt32Sums(const Params& params) noexcept -> bool {
+    return static_cast<uint64_t>(params.kernel.total()) * kGrayscaleMax <=
+           std::numeric_limits<uint32_t>::max();
+  }
+
+  // Fast path in one sweep per stripe of rows: the local min and max stream
+  // out of MinMaxFilter::ApplyRows, the local sums slide down the rows as in
+  // ChungkwongChanIntegralImageCalculator, and
+  // output = decision(pixel, min, max, sum) is written directly, so neither
+  // the min/max images nor an integral image are materialized. The local
+  // sums are exact integers, the output is the same whatever the local sums
+  // calculator and whatever SumType, uint32_t when FitsUInt32Sums or double.
+  template <class SumType, class OutputValue, class Params, class Decision>
+  void SweepFused(const cv::Mat& input,
+                  cv::Mat& output,
+                  const Params& params,
+                  BinarizationWorkspace* workspace,
+                  const Decision& decision) {
+    using AddRow      = std::plus<SumType>;
+    using SubtractRow = std::minus<SumType>;
+    constexpr auto kSumsType = std::is_integral_v<SumType> ? CV_32SC1
+                                                           : CV_64FC1;
+
+    // the min and max filters are fused into the traversal
+    const ScopedStageTimer timer{GetStats(workspace),
+                                 BinarizationStage::kTraversal,
+                                 input.total()};
+
+    const auto kernel_size  = params.kernel.size();
+    const auto delta_x      = (kernel_size.width - 1) / 2;
+    const auto delta_y      = (kernel_size.height - 1) / 2;
+    const auto width        = static_cast<size_t>(input.cols);
+    const auto padded_width = width + 2 * static_cast<size_t>(delta_x);
+
+    const MinMaxFilter min_max_filter{params.kernel, workspace};
+
+    // index of the input column for each column of the padded input
+    auto column_indices =
+      AcquireBuffer(workspace,
+                    WorkspaceSlot::kColumnIndices,
+                    cv::Size{static_cast<int>(padded_width), 1},
+                    CV_32SC1);
+    auto* index = column_indices.ptr<int>(0);
+    for (auto i = 0; i < column_indices.cols; ++i) {
+      index[i] = cv::borderInterpolate(i - delta_x,
+                                       input.cols,
+                                       cv::BorderTypes::BORDER_REFLECT);
+    }
+
+    // Every stripe of rows owns its scratch rows: the min/max filter ones,
+    // and the column sums over the kernel rows followed by their prefix sums
+    const auto stripe_count = GetStripeCount(input.rows);
+    auto min_max_buffers    = AcquireBuffer(
+      workspace,
+      WorkspaceSlot::kMinMaxFilterBuffers,
+      cv::Size{static_cast<int>(min_max_filter.GetStripeBufferSize(
+                 input.cols)),
+               stripe_count},
+      CV_8UC1);
+    auto sums_buffers = AcquireBuffer(
+      workspace,
+      WorkspaceSlot::kStripeBuffers,
+      cv::Size{static_cast<int>(width + padded_width + 1), stripe_count},
+      kSumsType);
+
+    cv::parallel_for_(
+      cv::Range{0, stripe_count},
+      [&input,
+       &output,
+       &min_max_filter,
+       &column_indices,
+       &min_max_buffers,
+       &sums_buffers,
+       &stripe_count,
+       &delta_x,
+       &delta_y,
+       &width,
+       &padded_width,
+       &decision](const cv::Range& stripes) {
+        const auto* indices = column_indices.ptr<int>(0);
+
+        for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+          auto* column_sums = sums_buffers.template ptr<SumType>(stripe);
+          auto* row_prefix  = column_sums + width;
+          std::fill_n(column_sums, width, SumType{0});
+          row_prefix[0] = SumType{0};
+
+          const auto rows = GetStripeRows(stripe, stripe_count, input.rows);
+
+          // same window as the local sums calculators: rows in
+          // [y - delta_y + 1, y + delta_y]
+          for (auto y = rows.start - delta_y + 1; y <= rows.start + delta_y;
+               ++y) {
+            AccumulateColumnSums<AddRow>(input, y, column_sums);
+          }
+
+          min_max_filter.ApplyRows(
+            input,
+            rows,
+            min_max_buffers.ptr<GrayscalePixel>(stripe),
+            [&input,
+             &output,
+             &decision,
+             &rows,
+             &delta_x,
+             &delta_y,
+             &width,
+             &padded_width,
+             indices,
+             column_sums,
+             row_prefix](const int y,
+                         const GrayscalePixel* min_row,
+                         const GrayscalePixel* max_row) {
+              if (y != rows.start) {
+                AccumulateColumnSums<AddRow>(input, y + delta_y, column_sums);
+                AccumulateColumnSums<SubtractRow>(input,
+                                                  y - delta_y,
+                                                  column_sums);
+              }
+
+              for (size_t i = 0; i < padded_width; ++i) {
+                row_prefix[i + 1] =
+                  row_prefix[i] + column_sums[static_cast<size_t>(indices[i])];
+              }
+
+              // columns in [x - delta_x + 1, x + delta_x]
+              const auto* sums_end   = row_prefix + 2 * delta_x + 1;
+              const auto* sums_begin = row_prefix + 1;
+
+              const auto* pixels = input.ptr<GrayscalePixel>(y);
+              auto* decided      = output.ptr<OutputValue>(y);
+              for (size_t x = 0; x < width; ++x) {
+                decided[x] = decision(
+                  pixels[x],
+                  min_row[x],
+                  max_row[x],
+                  static_cast<double>(sums_end[x] - sums_begin[x]));
+              }
+            });
+        }
+      },
+      static_cast<double>(stripe_count));
+  }
+
+  // SweepFused with uint32_t sums when they fit, double otherwise
+  template <class OutputValue, class Params, class Decision>
+  void DispatchSweepFused(const cv::Mat& input,
+                          cv::Mat& output,
+                          const Params& params,
+                          BinarizationWorkspace* workspace,
+                          const Decision& decision) {
+    if (FitsUInt32Sums(params)) {
+      SweepFused<uint32_t, OutputValue>(input,
+                                        output,
+                                        params,
+                                        workspace,
+                                        decision);
+    }
+    else {
+      SweepFused<double, OutputValue>(input,
+                                      output,
+                                      params,
+                                      workspace,
+                                      decision);
+    }
+  }
 }   // namespace
 
-auto Bernsen::ValidateParams([[maybe_unused]] const cv::Mat& input,
-                             const Params& params) const -> void {
+// static
+template <class LocalSumsCalculator>
+auto BasicBernsen<LocalSumsCalculator>::GetKernelSize(
+  const Params& params) noexcept -> cv::Size {
+  return params.kernel.size();
+}
+
+template <class LocalSumsCalculator>
+auto BasicBernsen<LocalSumsCalculator>::ValidateParams(
+  [[maybe_unused]] const cv::Mat& input,
+  const Params& params) const -> void {
   if (const softdouble ct{params.contrast_limit};
       !(ct >= softdouble::zero() && ct <= softdouble{255.0})) {
     CV_Error(ErrorCode::StsBadArg, "contrast limit is not in range [0-255]");
@@ -37,90 +385,179 @@ auto Bernsen::ValidateParams([[maybe_unused]] const cv::Mat& input,
     CV_Error(ErrorCode::StsBadArg,
              "kernel either is empty or has invalid dims (!= 2)");
   }
+
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if (params.kernel.type() != CV_8UC1) {
+    CV_Error(ErrorCode::StsBadArg, "kernel is not 8-bit, single channel");
+  }
 }
 
 // https://www.academia.edu/30363617/Implementation_of_Bernsen_s_Locally_Adaptive_Binarization_Method_for_Gray_Scale_Images
-auto Bernsen::BinarizeUnsafe(const cv::Mat& input,
-                             cv::Mat& output,
-                             const bool use_background_white_color,
-                             const Params& params) const -> void {
-  output = input.clone();
-  output.convertTo(output, CV_64F);
-
+template <class LocalSumsCalculator>
+auto BasicBernsen<LocalSumsCalculator>::BinarizeUnsafe(
+  const cv::Mat& input,
+  cv::Mat& output,
+  const bool use_background_white_color,
+  const Params& params,
+  const BinarizationContext& context) const -> void {
   const auto binary_colors = use_background_white_color
                                ? BinaryColorPair::Get()
                                : BinaryColorPair::GetInverse();
 
-  // Image contains max values based on neighbor pixels, which are constructed
-  // by kernel
-  cv::Mat min_filter;
-  cv::erode(
-    output,
-    min_filter,
-    params.kernel,
-    /* anchor, at kernel center */ cv::Point{-1, -1},
-    /* iterations */ 1,
-    /* border type */ cv::BorderTypes::BORDER_CONSTANT,
-    /* use default constant value */ cv::morphologyDefaultBorderValue());
-
-  // Image contains min values based on neighbor pixels, which are constructed
-  // by kernel
-  cv::Mat max_filter;
-  cv::dilate(
-    output,
-    max_filter,
-    params.kernel,
-    /* anchor, at kernel center */ cv::Point{-1, -1},
-    /* iterations */ 1,
-    /* border type */ cv::BorderTypes::BORDER_CONSTANT,
-    /* use default constant value */ cv::morphologyDefaultBorderValue());
-
-  IntegralImageCalculator::ConstructIntegralAndIterate<double, 1>(
+  output.create(input.size(), CV_8UC1);
+
+  // windows of whole blocks: the kernel shape is approximated by its bounding
+  // rectangle
+  if (context.grid_stride > 1) {
+    ThresholdGrid grid{input,
+                       params.kernel.size(),
+                       context.grid_stride,
+                       true /* with min max */,
+                       context.workspace};
+    grid.ComputeThresholds(
+      GridThreshold{params.global_threshold, params.contrast_limit});
+    DispatchPolarity(use_background_white_color,
+                     [&grid, &output](auto use_background_white) {
+                       grid.Binarize<decltype(use_background_white)::value>(
+                         output);
+                     });
+    return;
+  }
+
+  if (context.execution_mode == ExecutionMode::kFast) {
+    DispatchPolarity(
+      use_background_white_color,
+      [&input, &output, &params, &context](auto use_background_white) {
+        DispatchSweepFused<GrayscalePixel>(
+          input,
+          output,
+          params,
+          context.workspace,
+          MakeFastDecision<decltype(use_background_white)::value>(params));
+      });
+    return;
+  }
+
+  // Images of the min and max values of the neighbor pixels, which are
+  // selected by the kernel
+  auto min_filter = AcquireBuffer(context.workspace,
+                                  WorkspaceSlot::kMinFilter,
+                                  input.size(),
+                                  input.type());
+  auto max_filter = AcquireBuffer(context.workspace,
+                                  WorkspaceSlot::kMaxFilter,
+                                  input.size(),
+                                  input.type());
+  const MinMaxFilter min_max_filter{params.kernel, context.workspace};
+  min_max_filter.Apply(input, min_filter, max_filter);
+
+  LocalSumsCalculator::template ConstructIntegralAndIterate<1>(
+    input,
     output,
     params.kernel.size(),
-    [&binary_colors,
-     &min_filter,
+    context.workspace,
+    [&min_filter,
      &max_filter,
-     N  = softdouble{params.kernel.total()},
-     gt = softdouble{params.global_threshold},
-     ct = softdouble{params.contrast_limit}](
-      double& pixel,
+     decision = MakeReferenceDecision(binary_colors, params)](
+      const GrayscalePixel pixel,
       const int* position,
-      const IntegralImages& integral_images,
-      const KernelVertices& kernel_vertices) {
-      const auto& integral_1st_order = integral_images[0];
-
+      const LocalSums<1>& local_sums) {
       const auto y = position[0];
       const auto x = position[1];
 
-      const softdouble min{*min_filter.ptr<double>(y, x)};
-      const softdouble max{*max_filter.ptr<double>(y, x)};
+      return decision(pixel,
+                      *min_filter.ptr<GrayscalePixel>(y, x),
+                      *max_filter.ptr<GrayscalePixel>(y, x),
+                      local_sums[0]);
+    });
+}
+
+template <class LocalSumsCalculator>
+auto BasicBernsen<LocalSumsCalculator>::ComputeThresholdMapUnsafe(
+  const cv::Mat& input,
+  cv::Mat& map,
+  const int map_type,
+  const Params& params,
+  const BinarizationContext& context) const -> void {
+  map.create(input.size(), map_type);
+
+  DispatchMapType(map_type, [&input, &map, &params, &context](auto map_value) {
+    using MapValue = decltype(map_value);
+    DispatchSweepFused<MapValue>(
+      input,
+      map,
+      params,
+      context.workspace,
+      MapThreshold<MapValue>{1.0 / static_cast<double>(params.kernel.total()),
+                             params.global_threshold,
+                             params.contrast_limit});
+  });
+}
 
-      const auto local_contrast = max - min;
+template <class LocalSumsCalculator>
+auto BasicBernsen<LocalSumsCalculator>::BinarizeRowUnsafe(
+  const cv::Mat& rows,
+  const int row,
+  const LocalSumsRows<kLocalSumsOrder>& local_sums_rows,
+  GrayscalePixel* output,
+  const bool use_background_white_color,
+  const Params& params,
+  const BinarizationContext& context) const -> void {
+  const auto binary_colors = use_background_white_color
+                               ? BinaryColorPair::Get()
+                               : BinaryColorPair::GetInverse();
 
-      const softdouble i1i1{
-        *integral_1st_order.ptr<double>(kernel_vertices.bottom,
-                                        kernel_vertices.right)};
-      const softdouble i1i2{
-        *integral_1st_order.ptr<double>(kernel_vertices.top,
-                                        kernel_vertices.left)};
-      const softdouble i1i3{
-        *integral_1st_order.ptr<double>(kernel_vertices.bottom,
-                                        kernel_vertices.left)};
-      const softdouble i1i4{
-        *integral_1st_order.ptr<double>(kernel_vertices.top,
-                                        kernel_vertices.right)};
+  // |rows| holds the whole kernel window of |row|: filtering |row| reads its
+  // neighbor rows and only ignores pixels beyond |rows|, as the whole image
+  // filters do beyond the image
+  auto min_filter = AcquireBuffer(context.workspace,
+                                  WorkspaceSlot::kMinFilter,
+                                  cv::Size{rows.cols, 1},
+                                  rows.type());
+  auto max_filter = AcquireBuffer(context.workspace,
+                                  WorkspaceSlot::kMaxFilter,
+                                  cv::Size{rows.cols, 1},
+                                  rows.type());
+  const MinMaxFilter min_max_filter{params.kernel, context.workspace};
+  min_max_filter.ApplyRow(rows,
+                          row,
+                          min_filter.ptr<GrayscalePixel>(0),
+                          max_filter.ptr<GrayscalePixel>(0));
 
-      const auto mean = (i1i1 + i1i2 - i1i3 - i1i4) / N;
+  const auto* input = rows.ptr<GrayscalePixel>(row);
+  const auto width  = static_cast<size_t>(rows.cols);
 
-      if (local_contrast < ct) {
-        pixel = mean < gt ? binary_colors.object : binary_colors.background;
-      }
-      else {
-        pixel = softdouble{pixel} < mean ? binary_colors.object
-                                         : binary_colors.background;
-      }
-    });
+  if (context.execution_mode == ExecutionMode::kFast) {
+    DispatchPolarity(
+      use_background_white_color,
+      [input,
+       output,
+       &min_filter,
+       &max_filter,
+       &local_sums_rows,
+       &width,
+       &params](auto use_background_white) {
+        BinarizeRow(input,
+                    min_filter.ptr<GrayscalePixel>(0),
+                    max_filter.ptr<GrayscalePixel>(0),
+                    local_sums_rows[0],
+                    output,
+                    width,
+                    MakeFastDecision<decltype(use_background_white)::value>(
+                      params));
+      });
+    return;
+  }
 
-  output.convertTo(output, CV_8U);
+  BinarizeRow(input,
+              min_filter.ptr<GrayscalePixel>(0),
+              max_filter.ptr<GrayscalePixel>(0),
+              local_sums_rows[0],
+              output,
+              width,
+              MakeReferenceDecision(binary_colors, params));
 }
+
+template class longlp::imgproc::BasicBernsen<IntegralImageCalculator>;
+template class longlp::imgproc::BasicBernsen<
+  ChungkwongChanIntegralImageCalculator>;
@@ -5,11 +5,24 @@
 #ifndef IMGPROC_BINARIZATION_BERNSEN_HPP_
 #define IMGPROC_BINARIZATION_BERNSEN_HPP_
 
+#include <cstddef>
+
 #include <opencv2/imgproc.hpp>
 
+#include "imgproc/binarization/binarization_context.hpp"
+#include "imgproc/common/constant.hpp"
+#include "imgproc/common/local_sums.hpp"
+
 namespace longlp::imgproc {
+  class IntegralImageCalculator;
+  class ChungkwongChanIntegralImageCalculator;
 
-  class Bernsen final {
+  // |LocalSumsCalculator| computes the local mean, either
+  // IntegralImageCalculator or ChungkwongChanIntegralImageCalculator. The
+  // fast execution mode computes the local min, max and mean in a single
+  // sweep of its own instead, with the same result.
+  template <class LocalSumsCalculator>
+  class BasicBernsen final {
    public:
     struct Params {
       // value must be in range [0.0 - 255.0]
@@ -22,14 +35,51 @@ namespace longlp::imgproc {
       cv::Mat kernel{};
     };
 
+    // Size of the neighborhood each output pixel depends on
+    static auto GetKernelSize(const Params& params) noexcept -> cv::Size;
+
+    // Order of the local sums given to BinarizeRowUnsafe
+    static constexpr size_t kLocalSumsOrder = 1;
+
     auto BinarizeUnsafe(const cv::Mat& input,
                         cv::Mat& output,
                         bool use_background_white_color,
-                        const Params& params) const -> void;
+                        const Params& params,
+                        const BinarizationContext& context) const -> void;
+
+    // Local threshold of every pixel of |input| as a threshold map of
+    // |map_type|, CV_8UC1 or CV_32FC1, see ApplyThresholdMap. Computed with
+    // hardware doubles whatever the execution mode and grid stride: applying
+    // a CV_32FC1 map gives the kFast output.
+    auto ComputeThresholdMapUnsafe(const cv::Mat& input,
+                                   cv::Mat& map,
+                                   int map_type,
+                                   const Params& params,
+                                   const BinarizationContext& context) const
+      -> void;
+
+    // Binarizes the row |row| of |rows| into |output|: |rows| are consecutive
+    // input rows holding the kernel window of |row| clipped to the image, and
+    // |local_sums_rows| are the local sums of |row|
+    auto BinarizeRowUnsafe(
+      const cv::Mat& rows,
+      int row,
+      const LocalSumsRows<kLocalSumsOrder>& local_sums_rows,
+      GrayscalePixel* output,
+      bool use_background_white_color,
+      const Params& params,
+      const BinarizationContext& context) const -> void;
 
     auto ValidateParams(const cv::Mat& input, const Params& params) const
       -> void;
   };
+
+  extern template class BasicBernsen<IntegralImageCalculator>;
+  extern template class BasicBernsen<ChungkwongChanIntegralImageCalculator>;
+
+  using Bernsen = BasicBernsen<IntegralImageCalculator>;
+  using ChungkwongChanBernsen =
+    BasicBernsen<ChungkwongChanIntegralImageCalculator>;
 }   // namespace longlp::imgproc
 
 #endif   // IMGPROC_BINARIZATION_BERNSEN_HPP_
@@ -6,11 +6,16 @@
 #define IMGPROC_BINARIZATION_BINARIZATION_HPP_
 
 #include "imgproc/binarization/binarization_algorithm.hpp"
+#include "imgproc/binarization/binarization_context.hpp"
 #include "imgproc/binarization/binarization_validator.hpp"
+#include "imgproc/binarization/streaming_binarizer.hpp"
+#include "imgproc/binarization/tiled_binarization_algorithm.hpp"
 
 #include "imgproc/binarization/bernsen.hpp"
 #include "imgproc/binarization/niblack.hpp"
 #include "imgproc/binarization/otsu.hpp"
 #include "imgproc/binarization/sauvola.hpp"
 
+#include "imgproc/common/threshold_map.hpp"
+
 #endif   // IMGPROC_BINARIZATION_BINARIZATION_HPP_
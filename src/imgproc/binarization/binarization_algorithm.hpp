@@ -5,15 +5,25 @@
 #ifndef IMGPROC_BINARIZATION_BINARIZATION_ALGORITHM_HPP_
 #define IMGPROC_BINARIZATION_BINARIZATION_ALGORITHM_HPP_
 
+#include <algorithm>   // std::sort, std::min
+#include <atomic>      // next page of BinarizeBatch
 #include <concepts>
-#include <memory>   // method_
+#include <cstddef>
+#include <memory>    // method_
+#include <numeric>   // std::iota
+#include <span>      // BinarizeBatch, Sweep
 #include <type_traits>
+#include <vector>
 
 #include <fmt/format.h>   // name
 #include <nameof.hpp>     // name
 #include <opencv2/core.hpp>
 
+#include "imgproc/binarization/binarization_context.hpp"
 #include "imgproc/binarization/binarization_validator.hpp"
+#include "imgproc/common/mat_overlap.hpp"
+#include "imgproc/common/packed_binary_image.hpp"
+#include "imgproc/common/parameter_sweep.hpp"
 
 namespace longlp::imgproc {
 
@@ -29,22 +39,482 @@ namespace longlp::imgproc {
                       const cv::Mat& input,
                       cv::Mat& output,
                       const bool use_background_white_color,
-                      const typename T::Params& params) {
+                      const typename T::Params& params,
+                      const BinarizationContext& context) {
       {
-        t.BinarizeUnsafe(input, output, use_background_white_color, params)
+        t.BinarizeUnsafe(input,
+                         output,
+                         use_background_white_color,
+                         params,
+                         context)
         } -> std::same_as<void>;
     };
   };
 
+  // Methods deciding each pixel against a local threshold, which can be
+  // computed on its own
+  template <class T>
+  concept ThresholdMapMethodInterface =
+    requires(const T& t,
+             const cv::Mat& input,
+             cv::Mat& map,
+             const int map_type,
+             const typename T::Params& params,
+             const BinarizationContext& context) {
+    {
+      t.ComputeThresholdMapUnsafe(input, map, map_type, params, context)
+      } -> std::same_as<void>;
+  };
+
+  // Methods emitting bit-packed rows directly
+  template <class T>
+  concept PackedOutputMethodInterface =
+    requires(const T& t,
+             const cv::Mat& input,
+             PackedBinaryImage& output,
+             const bool use_background_white_color,
+             const typename T::Params& params,
+             const BinarizationContext& context) {
+    {
+      t.BinarizePackedUnsafe(input,
+                             output,
+                             use_background_white_color,
+                             params,
+                             context)
+      } -> std::same_as<void>;
+  };
+
+  // Methods deciding each pixel against a threshold of its local mean and
+  // standard deviation, which can binarize with many params at once from one
+  // set of local statistics
+  template <class T>
+  concept ParameterSweepMethodInterface =
+    requires(const T& t,
+             const cv::Mat& input,
+             const cv::Mat& ground_truth,
+             std::span<cv::Mat> outputs,
+             std::span<SweepScore> scores,
+             const bool use_background_white_color,
+             std::span<const typename T::Params> params,
+             const BinarizationContext& context) {
+    {
+      t.SweepUnsafe(input,
+                    outputs,
+                    use_background_white_color,
+                    params,
+                    context)
+      } -> std::same_as<void>;
+    {
+      t.ScoreSweepUnsafe(input, ground_truth, scores, params, context)
+      } -> std::same_as<void>;
+    { T::GetKernelSize(params.front()) } -> std::same_as<cv::Size>;
+  };
+
   template <BinarizationMethodInterface MethodType>
   class BinarizationAlgorithm {
    public:
     using Params = typename MethodType::Params;
 
+    BinarizationAlgorithm() = default;
+
+    explicit BinarizationAlgorithm(const ExecutionMode execution_mode) :
+      context_{execution_mode} {}
+
+    // |grid_stride| > 1 trades accuracy for speed, see
+    // BinarizationContext::grid_stride
+    BinarizationAlgorithm(const ExecutionMode execution_mode,
+                          const int grid_stride) :
+      context_{execution_mode, nullptr, grid_stride} {
+      // pre-conditions
+      if (grid_stride < 1) {
+        CV_Error(cv::Error::Code::StsBadArg, "grid stride must be positive");
+      }
+    }
+
+    // |output| is written in place when it already is an 8-bit single channel
+    // image of the size of |input| and does not share data with |input|,
+    // otherwise it is (re)allocated. |output| may be |input| itself.
     void Binarize(const cv::Mat& input,
                   cv::Mat& output,
                   const bool use_background_white_color,
                   const Params& params) const {
+      BinarizeWithContext(input,
+                          output,
+                          use_background_white_color,
+                          params,
+                          context_);
+    }
+
+    // Same as above, temporaries are taken from |workspace| so that repeated
+    // calls on same-sized images do not allocate once it has warmed up
+    void Binarize(const cv::Mat& input,
+                  cv::Mat& output,
+                  const bool use_background_white_color,
+                  const Params& params,
+                  BinarizationWorkspace& workspace) const {
+      auto context      = context_;
+      context.workspace = &workspace;
+      BinarizeWithContext(input,
+                          output,
+                          use_background_white_color,
+                          params,
+                          context);
+    }
+
+    // Same as Binarize, with |output| packed to one bit per pixel, set for
+    // the black pixels, see PackedBinaryImage: 8x smaller to keep, write or
+    // encode. Methods satisfying PackedOutputMethodInterface pack the rows as
+    // they are decided, the output of the others is packed afterwards.
+    void BinarizePacked(const cv::Mat& input,
+                        PackedBinaryImage& output,
+                        const bool use_background_white_color,
+                        const Params& params) const {
+      BinarizePackedWithContext(input,
+                                output,
+                                use_background_white_color,
+                                params,
+                                context_);
+    }
+
+    // Same as above, temporaries are taken from |workspace|
+    void BinarizePacked(const cv::Mat& input,
+                        PackedBinaryImage& output,
+                        const bool use_background_white_color,
+                        const Params& params,
+                        BinarizationWorkspace& workspace) const {
+      auto context      = context_;
+      context.workspace = &workspace;
+      BinarizePackedWithContext(input,
+                                output,
+                                use_background_white_color,
+                                params,
+                                context);
+    }
+
+    // Binarizes |inputs[i]| into |outputs[i]| for every page, pages run
+    // concurrently, one per worker thread at a time. Each worker owns a
+    // BinarizationWorkspace and takes the next page as soon as it is done
+    // with its own, largest pages first, so that mixed page sizes keep every
+    // worker busy until the end. Calls of OpenCV parallel loops inside a
+    // page run serially on its worker, as OpenCV does not nest them.
+    void BinarizeBatch(std::span<const cv::Mat> inputs,
+                       std::span<cv::Mat> outputs,
+                       const bool use_background_white_color,
+                       const Params& params) const {
+      // pre-conditions
+      if (inputs.size() != outputs.size()) {
+        CV_Error(cv::Error::Code::StsBadArg,
+                 "inputs and outputs do not have the same number of pages");
+      }
+      // validated up front, so that workers do not throw
+      for (const auto& input : inputs) {
+        Validate(input, params);
+      }
+
+      std::vector<size_t> pages(inputs.size());
+      std::iota(pages.begin(), pages.end(), size_t{0});
+      std::sort(pages.begin(), pages.end(), [&inputs](size_t lhs, size_t rhs) {
+        return inputs[lhs].total() > inputs[rhs].total();
+      });
+
+      const auto worker_count =
+        static_cast<int>(std::min(pages.size(),
+                                  static_cast<size_t>(cv::getNumThreads())));
+      std::atomic<size_t> next_page{0};
+
+      cv::parallel_for_(
+        cv::Range{0, worker_count},
+        [this,
+         &inputs,
+         &outputs,
+         &use_background_white_color,
+         &params,
+         &pages,
+         // a stripe of several workers runs them as one
+         &next_page]([[maybe_unused]] const cv::Range& workers) {
+          BinarizationWorkspace workspace;
+          auto context      = context_;
+          context.workspace = &workspace;
+
+          for (auto page = next_page++; page < pages.size();
+               page      = next_page++) {
+            BinarizeValidated(inputs[pages[page]],
+                              outputs[pages[page]],
+                              use_background_white_color,
+                              params,
+                              context);
+          }
+        },
+        static_cast<double>(worker_count));
+    }
+
+    // Threshold map of |input| of |map_type|, CV_8UC1 or CV_32FC1, to be
+    // given to ApplyThresholdMap, so that it can be cached and reused across
+    // inputs of the same layout or combined with other maps
+    void ComputeThresholdMap(const cv::Mat& input,
+                             cv::Mat& map,
+                             const int map_type,
+                             const Params& params) const
+      requires ThresholdMapMethodInterface<MethodType> {
+      ComputeThresholdMapWithContext(input, map, map_type, params, context_);
+    }
+
+    // Same as above, temporaries are taken from |workspace|
+    void ComputeThresholdMap(const cv::Mat& input,
+                             cv::Mat& map,
+                             const int map_type,
+                             const Params& params,
+                             BinarizationWorkspace& workspace) const
+      requires ThresholdMapMethodInterface<MethodType> {
+      auto context      = context_;
+      context.workspace = &workspace;
+      ComputeThresholdMapWithContext(input, map, map_type, params, context);
+    }
+
+    // Binarizes |input| into outputs[i] with params[i] for every params, as
+    // Binarize in the kFast execution mode whatever the execution mode and
+    // grid stride. The local statistics are computed once and shared by
+    // every params, which must all have the same kernel size: tuning a
+    // method costs about one statistics pass plus a cheap decision pass per
+    // params instead of a full Binarize per params.
+    void Sweep(const cv::Mat& input,
+               std::span<cv::Mat> outputs,
+               const bool use_background_white_color,
+               std::span<const Params> params) const
+      requires ParameterSweepMethodInterface<MethodType> {
+      SweepWithContext(input,
+                       outputs,
+                       use_background_white_color,
+                       params,
+                       context_);
+    }
+
+    // Same as above, temporaries are taken from |workspace|
+    void Sweep(const cv::Mat& input,
+               std::span<cv::Mat> outputs,
+               const bool use_background_white_color,
+               std::span<const Params> params,
+               BinarizationWorkspace& workspace) const
+      requires ParameterSweepMethodInterface<MethodType> {
+      auto context      = context_;
+      context.workspace = &workspace;
+      SweepWithContext(input,
+                       outputs,
+                       use_background_white_color,
+                       params,
+                       context);
+    }
+
+    // Same as Sweep, but only the pixel counts of every params are returned,
+    // against |ground_truth| when it is not empty, see SweepScore. No output
+    // is written.
+    auto ScoreSweep(const cv::Mat& input,
+                    const cv::Mat& ground_truth,
+                    std::span<const Params> params) const
+      -> std::vector<SweepScore>
+      requires ParameterSweepMethodInterface<MethodType> {
+      return ScoreSweepWithContext(input, ground_truth, params, context_);
+    }
+
+    // Same as above, temporaries are taken from |workspace|
+    auto ScoreSweep(const cv::Mat& input,
+                    const cv::Mat& ground_truth,
+                    std::span<const Params> params,
+                    BinarizationWorkspace& workspace) const
+      -> std::vector<SweepScore>
+      requires ParameterSweepMethodInterface<MethodType> {
+      auto context      = context_;
+      context.workspace = &workspace;
+      return ScoreSweepWithContext(input, ground_truth, params, context);
+    }
+
+    [[nodiscard]] auto name() const noexcept -> std::string {
+      return fmt::format(
+        "{algo}_{impl}",
+        fmt::arg("algo", nameof::nameof_short_type<BinarizationAlgorithm>()),
+        fmt::arg("impl", nameof::nameof_short_type<MethodType>()));
+    }
+
+    [[nodiscard]] auto execution_mode() const noexcept -> ExecutionMode {
+      return context_.execution_mode;
+    }
+
+    [[nodiscard]] auto grid_stride() const noexcept -> int {
+      return context_.grid_stride;
+    }
+
+   private:
+    void BinarizeWithContext(const cv::Mat& input,
+                             cv::Mat& output,
+                             const bool use_background_white_color,
+                             const Params& params,
+                             const BinarizationContext& context) const {
+      {
+        const ScopedStageTimer timer{GetStats(context.workspace),
+                                     BinarizationStage::kValidation,
+                                     input.total()};
+        Validate(input, params);
+      }
+      BinarizeValidated(input,
+                        output,
+                        use_background_white_color,
+                        params,
+                        context);
+    }
+
+    void BinarizePackedWithContext(const cv::Mat& input,
+                                   PackedBinaryImage& output,
+                                   const bool use_background_white_color,
+                                   const Params& params,
+                                   const BinarizationContext& context) const {
+      auto* stats = GetStats(context.workspace);
+      {
+        const ScopedStageTimer timer{stats,
+                                     BinarizationStage::kValidation,
+                                     input.total()};
+        Validate(input, params);
+      }
+
+      if constexpr (PackedOutputMethodInterface<MethodType>) {
+        const ScopedStageTimer timer{stats,
+                                     BinarizationStage::kMethod,
+                                     input.total()};
+        method_->BinarizePackedUnsafe(input,
+                                      output,
+                                      use_background_white_color,
+                                      params,
+                                      context);
+      }
+      else {
+        auto unpacked = AcquireBuffer(context.workspace,
+                                      WorkspaceSlot::kUnpackedOutput,
+                                      input.size(),
+                                      CV_8UC1);
+        BinarizeValidated(input,
+                          unpacked,
+                          use_background_white_color,
+                          params,
+                          context);
+        output.Pack(unpacked);
+      }
+
+      // post-conditions
+      if (output.size() != input.size()) {
+        CV_Error(cv::Error::Code::StsInternal,
+                 "packed output does not have the size of input");
+      }
+    }
+
+    void ComputeThresholdMapWithContext(
+      const cv::Mat& input,
+      cv::Mat& map,
+      const int map_type,
+      const Params& params,
+      const BinarizationContext& context) const {
+      // pre-conditions
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (map_type != CV_8UC1 && map_type != CV_32FC1) {
+        CV_Error(cv::Error::Code::StsBadArg,
+                 "map type is neither CV_8UC1 nor CV_32FC1");
+      }
+      Validate(input, params);
+
+      // same as BinarizeValidated, |map| may share data with |input|
+      const cv::Mat source = input;
+      if (SharesData(source, map)) {
+        map.release();
+      }
+
+      method_->ComputeThresholdMapUnsafe(source,
+                                         map,
+                                         map_type,
+                                         params,
+                                         context);
+
+      // post-conditions
+      if (map.type() != map_type || map.size() != source.size()) {
+        CV_Error(cv::Error::Code::StsInternal,
+                 "map does not have the requested type or the input size");
+      }
+    }
+
+    void SweepWithContext(const cv::Mat& input,
+                          std::span<cv::Mat> outputs,
+                          const bool use_background_white_color,
+                          std::span<const Params> params,
+                          const BinarizationContext& context) const {
+      // pre-conditions
+      if (outputs.size() != params.size()) {
+        CV_Error(cv::Error::Code::StsBadArg,
+                 "outputs and params do not have the same count");
+      }
+      ValidateSweep(input, params);
+      if (params.empty()) {
+        return;
+      }
+
+      // same as BinarizeValidated, every output is written while the input
+      // is still read for the next params
+      const cv::Mat source = input;
+      for (auto& output : outputs) {
+        if (SharesData(source, output)) {
+          output.release();
+        }
+      }
+
+      method_->SweepUnsafe(source,
+                           outputs,
+                           use_background_white_color,
+                           params,
+                           context);
+
+      // post-conditions
+      for (const auto& output : outputs) {
+        if (output.type() != source.type() || output.size() != source.size()) {
+          CV_Error(cv::Error::Code::StsInternal,
+                   "output image does not have the same type or size as "
+                   "input");
+        }
+      }
+    }
+
+    auto ScoreSweepWithContext(const cv::Mat& input,
+                               const cv::Mat& ground_truth,
+                               std::span<const Params> params,
+                               const BinarizationContext& context) const
+      -> std::vector<SweepScore> {
+      // pre-conditions
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (!ground_truth.empty() && (ground_truth.type() != CV_8UC1 ||
+                                    ground_truth.size() != input.size())) {
+        CV_Error(cv::Error::Code::StsBadArg,
+                 "ground truth must be 8-bit, single channel with the size "
+                 "of input");
+      }
+      ValidateSweep(input, params);
+
+      std::vector<SweepScore> scores(params.size());
+      if (!params.empty()) {
+        method_->ScoreSweepUnsafe(input, ground_truth, scores, params, context);
+      }
+      return scores;
+    }
+
+    void ValidateSweep(const cv::Mat& input,
+                       std::span<const Params> params) const {
+      for (const auto& param : params) {
+        Validate(input, param);
+
+        // pre-conditions
+        if (MethodType::GetKernelSize(param) !=
+            MethodType::GetKernelSize(params.front())) {
+          CV_Error(cv::Error::Code::StsBadArg,
+                   "swept params do not have the same kernel size");
+        }
+      }
+    }
+
+    void Validate(const cv::Mat& input, const Params& params) const {
       // pre-conditions
       // NOLINTNEXTLINE(hicpp-signed-bitwise)
       if (input.type() != CV_8UC1 || input.dims != 2) {
@@ -57,33 +527,53 @@ namespace longlp::imgproc {
       BinarizationValidator<MethodType>::ValidateParams(*method_,
                                                         input,
                                                         params);
+    }
+
+    void BinarizeValidated(const cv::Mat& input,
+                           cv::Mat& output,
+                           const bool use_background_white_color,
+                           const Params& params,
+                           const BinarizationContext& context) const {
+      // methods read |input| while writing |output|, keep a reference on the
+      // input data and detach |output| from it when they overlap
+      const cv::Mat source = input;
+      if (SharesData(source, output)) {
+        output.release();
+      }
+
+      auto* stats = GetStats(context.workspace);
+      const ScopedStageTimer timer{stats,
+                                   BinarizationStage::kMethod,
+                                   source.total()};
+      [[maybe_unused]] const auto* output_data = output.data;
 
-      method_->BinarizeUnsafe(input,
+      method_->BinarizeUnsafe(source,
                               output,
                               use_background_white_color,
-                              params);
+                              params,
+                              context);
+
+      // the output is the only buffer not taken from the workspace
+      if constexpr (kInstrumentationEnabled) {
+        if (stats != nullptr && output.data != output_data) {
+          stats->AddAllocation(output.total() * output.elemSize());
+        }
+      }
 
       // post-conditions
-      if (output.type() != input.type() || output.dims != input.dims ||
-          input.size() != output.size()) {
+      if (output.type() != source.type() || output.dims != source.dims ||
+          source.size() != output.size()) {
         CV_Error(
           cv::Error::Code::StsInternal,
           "output image does not have the same type, size or dims as input");
       }
       BinarizationValidator<MethodType>::ValidateOutput(*method_,
-                                                        input,
+                                                        source,
                                                         output);
     }
 
-    [[nodiscard]] auto name() const noexcept -> std::string {
-      return fmt::format(
-        "{algo}_{impl}",
-        fmt::arg("algo", nameof::nameof_short_type<BinarizationAlgorithm>()),
-        fmt::arg("impl", nameof::nameof_short_type<MethodType>()));
-    }
-
-   private:
     std::unique_ptr<MethodType> method_ = std::make_unique<MethodType>();
+    BinarizationContext context_{};
   };
 
 }   // namespace longlp::imgproc
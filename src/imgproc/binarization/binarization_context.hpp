@@ -0,0 +1,39 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_BINARIZATION_BINARIZATION_CONTEXT_HPP_
+#define IMGPROC_BINARIZATION_BINARIZATION_CONTEXT_HPP_
+
+#include <cstdint>
+
+#include "imgproc/common/binarization_workspace.hpp"
+
+namespace longlp::imgproc {
+
+  enum class ExecutionMode : uint8_t {
+    // cv::softdouble arithmetic, bit-exact on every platform
+    kReference,
+
+    // hardware floating point, vectorized across rows with OpenCV universal
+    // intrinsics, may differ from kReference in the last bits of thresholds
+    kFast,
+  };
+
+  // Per-call settings forwarded by BinarizationAlgorithm to the method
+  struct BinarizationContext {
+    ExecutionMode execution_mode{ExecutionMode::kReference};
+
+    // temporaries are allocated per call when null
+    BinarizationWorkspace* workspace{nullptr};
+
+    // 1: thresholds of every pixel. n > 1: opt-in approximation of the local
+    // methods (NiBlack, Sauvola, Bernsen), thresholds of n x n blocks
+    // bilinearly interpolated, see ThresholdGrid, whatever execution_mode.
+    // Other methods ignore it.
+    int grid_stride{1};
+  };
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_BINARIZATION_BINARIZATION_CONTEXT_HPP_
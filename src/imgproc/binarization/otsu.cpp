@@ -4,16 +4,253 @@
 
 #include "imgproc/binarization/otsu.hpp"
 
+#include <algorithm>   // std::min, std::max
+#include <array>       // retrance row
+#include <cstddef>
+#include <limits>
+#include <utility>   // std::pair
+
+#include <opencv2/core/hal/intrin.hpp>
 #include <opencv2/core/softfloat.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "imgproc/common/binarization_workspace.hpp"
 #include "imgproc/common/constant.hpp"
+#include "imgproc/common/joint_histogram.hpp"
 
 namespace {
+  using longlp::imgproc::ExecutionMode;
+  using longlp::imgproc::kJointHistogramSize;
   using longlp::imgproc::Otsu2D;
+  using longlp::imgproc::WorkspaceSlot;
 
   using cv::softdouble;
   using ErrorCode = cv::Error::Code;
+
+  // one bin per gray level of the input and of the guided image
+  constexpr auto kHistogramSize = kJointHistogramSize;
+
+  // threshold of the input (s) and of the guided image (t)
+  using ThresholdPair = std::pair<int, int>;
+
+  // Exhaustive search with cv::softdouble. |P|, |X| and |Y| are the integrals
+  // of the 2D histogram f, of s * f and of t * f.
+  auto SearchExhaustiveReference(const cv::Mat& P,
+                                 const cv::Mat& X,
+                                 const cv::Mat& Y) -> ThresholdPair {
+    auto threshold_s  = 0;
+    auto threshold_t  = 0;
+    auto max_retrance = softdouble::zero();
+
+    for (auto s = 0; s < kHistogramSize; ++s) {
+      for (auto t = 0; t < kHistogramSize; ++t) {
+        const auto y = s + 1;
+        const auto x = t + 1;
+
+        const softdouble X0{*X.ptr<double>(y, x)};
+        const softdouble Y0{*Y.ptr<double>(y, x)};
+
+        const softdouble X1{*X.ptr<double>(256, 256) - *X.ptr<double>(256, x) -
+                            *X.ptr<double>(y, 256) + X0};
+        const softdouble Y1{*Y.ptr<double>(256, 256) - *Y.ptr<double>(256, x) -
+                            *Y.ptr<double>(y, 256) + Y0};
+
+        const softdouble w0{*P.ptr<double>(y, x)};
+        if (!(w0 > softdouble::eps())) {
+          continue;
+        }
+
+        const softdouble w1{*P.ptr<double>(256, 256) - *P.ptr<double>(256, x) -
+                            *P.ptr<double>(y, 256) + *P.ptr<double>(y, x)};
+        if (!(w1 > softdouble::eps())) {
+          break;
+        }
+
+        const auto u0 = (X0 + Y0) / (w0 + w0);
+        const auto u1 = (X1 + Y1) / (w1 + w1);
+        const auto ut = w0 * u0 + w1 * u1;
+
+        if (const auto local_retrance =
+              w0 * (ut - u0) * (ut - u0) + w1 * (ut - u1) * (ut - u1);
+            local_retrance > max_retrance) {
+          max_retrance = local_retrance;
+          threshold_s  = s;
+          threshold_t  = t;
+        }
+      }
+    }
+    return {threshold_s, threshold_t};
+  }
+
+  // Integral rows read by the row s of the search: the sums of region A
+  // ([0, s] x [0, t]) are in the row s + 1, those of region C follow from
+  // the last row and the totals of the rows after s, all contiguous along t
+  struct RetranceRow {
+    const double* P_row;
+    const double* X_row;
+    const double* Y_row;
+    const double* P_last;
+    const double* X_last;
+    const double* Y_last;
+    double P_rest;   // P(256, 256) - P(y, 256)
+    double X_rest;
+    double Y_rest;
+  };
+
+  // retrance[t] = between-class variance of (s, t), or -1 for pairs whose
+  // regions A or C are empty, with hardware doubles vectorized along t.
+  // Region C only shrinks as t grows, so masking the pairs whose C is empty
+  // matches the reference search, which stops at the first one.
+  void ComputeRetranceRow(const RetranceRow& row,
+                          std::array<double, kHistogramSize>& retrance) {
+    constexpr auto kEpsilon = std::numeric_limits<double>::epsilon();
+
+    size_t t = 0;
+#if CV_SIMD_64F
+    const auto lanes =
+      static_cast<size_t>(cv::VTraits<cv::v_float64>::vlanes());
+    const auto v_epsilon = cv::vx_setall_f64(kEpsilon);
+    const auto v_invalid = cv::vx_setall_f64(-1.0);
+    const auto v_P_rest  = cv::vx_setall_f64(row.P_rest);
+    const auto v_X_rest  = cv::vx_setall_f64(row.X_rest);
+    const auto v_Y_rest  = cv::vx_setall_f64(row.Y_rest);
+
+    for (; t + lanes <= kHistogramSize; t += lanes) {
+      const auto x = t + 1;
+
+      const auto w0 = cv::vx_load(row.P_row + x);
+      const auto X0 = cv::vx_load(row.X_row + x);
+      const auto Y0 = cv::vx_load(row.Y_row + x);
+
+      const auto w1 =
+        cv::v_add(cv::v_sub(v_P_rest, cv::vx_load(row.P_last + x)), w0);
+      const auto X1 =
+        cv::v_add(cv::v_sub(v_X_rest, cv::vx_load(row.X_last + x)), X0);
+      const auto Y1 =
+        cv::v_add(cv::v_sub(v_Y_rest, cv::vx_load(row.Y_last + x)), Y0);
+
+      const auto u0 = cv::v_div(cv::v_add(X0, Y0), cv::v_add(w0, w0));
+      const auto u1 = cv::v_div(cv::v_add(X1, Y1), cv::v_add(w1, w1));
+      const auto ut = cv::v_add(cv::v_mul(w0, u0), cv::v_mul(w1, u1));
+
+      const auto d0 = cv::v_sub(ut, u0);
+      const auto d1 = cv::v_sub(ut, u1);
+      const auto local_retrance =
+        cv::v_add(cv::v_mul(w0, cv::v_mul(d0, d0)),
+                  cv::v_mul(w1, cv::v_mul(d1, d1)));
+
+      const auto is_valid =
+        cv::v_and(cv::v_gt(w0, v_epsilon), cv::v_gt(w1, v_epsilon));
+      cv::v_store(retrance.data() + t,
+                  cv::v_select(is_valid, local_retrance, v_invalid));
+    }
+    cv::vx_cleanup();
+#endif
+    for (; t < kHistogramSize; ++t) {
+      const auto x = t + 1;
+
+      const auto w0 = row.P_row[x];
+      const auto X0 = row.X_row[x];
+      const auto Y0 = row.Y_row[x];
+
+      const auto w1 = row.P_rest - row.P_last[x] + w0;
+      const auto X1 = row.X_rest - row.X_last[x] + X0;
+      const auto Y1 = row.Y_rest - row.Y_last[x] + Y0;
+
+      if (!(w0 > kEpsilon && w1 > kEpsilon)) {
+        retrance[t] = -1.0;
+        continue;
+      }
+
+      const auto u0 = (X0 + Y0) / (w0 + w0);
+      const auto u1 = (X1 + Y1) / (w1 + w1);
+      const auto ut = w0 * u0 + w1 * u1;
+
+      retrance[t] = w0 * (ut - u0) * (ut - u0) + w1 * (ut - u1) * (ut - u1);
+    }
+  }
+
+  // Same search as SearchExhaustiveReference with hardware doubles
+  auto SearchExhaustiveFast(const cv::Mat& P,
+                            const cv::Mat& X,
+                            const cv::Mat& Y) -> ThresholdPair {
+    auto threshold_s  = 0;
+    auto threshold_t  = 0;
+    auto max_retrance = 0.0;
+
+    std::array<double, kHistogramSize> retrance{};
+    for (auto s = 0; s < kHistogramSize; ++s) {
+      const auto y = s + 1;
+
+      const RetranceRow row{
+        P.ptr<double>(y),
+        X.ptr<double>(y),
+        Y.ptr<double>(y),
+        P.ptr<double>(kHistogramSize),
+        X.ptr<double>(kHistogramSize),
+        Y.ptr<double>(kHistogramSize),
+        *P.ptr<double>(kHistogramSize, kHistogramSize) -
+          *P.ptr<double>(y, kHistogramSize),
+        *X.ptr<double>(kHistogramSize, kHistogramSize) -
+          *X.ptr<double>(y, kHistogramSize),
+        *Y.ptr<double>(kHistogramSize, kHistogramSize) -
+          *Y.ptr<double>(y, kHistogramSize)};
+      ComputeRetranceRow(row, retrance);
+
+      // first maximum, as the reference search
+      for (auto t = 0; t < kHistogramSize; ++t) {
+        if (retrance[static_cast<size_t>(t)] > max_retrance) {
+          max_retrance = retrance[static_cast<size_t>(t)];
+          threshold_s  = s;
+          threshold_t  = t;
+        }
+      }
+    }
+    return {threshold_s, threshold_t};
+  }
+
+  // 1D Otsu over a histogram given by its cumulative counts and cumulative
+  // first moments, cumulative[k + 1] covering the bins [0, k]
+  template <class CumulativeCount, class CumulativeMoment>
+  auto SearchOtsu1D(const CumulativeCount& cumulative_count,
+                    const CumulativeMoment& cumulative_moment) -> int {
+    const auto total_count  = cumulative_count(kHistogramSize);
+    const auto total_moment = cumulative_moment(kHistogramSize);
+
+    auto threshold    = 0;
+    auto max_variance = 0.0;
+    for (auto k = 0; k < kHistogramSize; ++k) {
+      const auto w0 = cumulative_count(k + 1);
+      const auto w1 = total_count - w0;
+      if (!(w0 > 0.0 && w1 > 0.0)) {
+        continue;
+      }
+
+      const auto m0 = cumulative_moment(k + 1);
+      const auto u0 = m0 / w0;
+      const auto u1 = (total_moment - m0) / w1;
+
+      if (const auto variance = w0 * w1 * (u0 - u1) * (u0 - u1);
+          variance > max_variance) {
+        max_variance = variance;
+        threshold    = k;
+      }
+    }
+    return threshold;
+  }
+
+  // s and t searched independently on the marginal histograms of f, which
+  // are the last column and the last row of the integrals
+  auto SearchDecomposed(const cv::Mat& P, const cv::Mat& X, const cv::Mat& Y)
+    -> ThresholdPair {
+    const auto threshold_s = SearchOtsu1D(
+      [&P](const int y) { return *P.ptr<double>(y, kHistogramSize); },
+      [&X](const int y) { return *X.ptr<double>(y, kHistogramSize); });
+    const auto threshold_t = SearchOtsu1D(
+      [&P](const int x) { return *P.ptr<double>(kHistogramSize, x); },
+      [&Y](const int x) { return *Y.ptr<double>(kHistogramSize, x); });
+    return {threshold_s, threshold_t};
+  }
 }   // namespace
 
 auto Otsu2D::InvalidateParams(const cv::Mat& input, const Params& params) const
@@ -22,9 +259,10 @@ auto Otsu2D::InvalidateParams(const cv::Mat& input, const Params& params) const
     CV_Error(ErrorCode::StsBadArg, "kernel size is empty");
   }
 
-  if (params.guided_image.empty() ||
-      params.guided_image.type() != input.type() ||
-      params.guided_image.size() != input.size()) {
+  // the guided image is built internally when empty
+  if (!params.guided_image.empty() &&
+      (params.guided_image.type() != input.type() ||
+       params.guided_image.size() != input.size())) {
     CV_Error(ErrorCode::StsBadArg,
              "guided image does not have the same size and type as input");
   }
@@ -34,45 +272,47 @@ auto Otsu2D::InvalidateParams(const cv::Mat& input, const Params& params) const
 void Otsu2D::BinarizeUnsafe(const cv::Mat& input,
                             cv::Mat& output,
                             const bool use_background_white_color,
-                            const Params& params) const {
-  output = input.clone();
-  output.convertTo(output, CV_64F);
-
-  cv::Mat merged;
-  {
-    const std::vector<cv::Mat> merge_list({input, params.guided_image});
-    cv::merge(merge_list, merged);
+                            const Params& params,
+                            const BinarizationContext& context) const {
+  // Create 2D histogram of the input and the guided image
+  auto f = AcquireBuffer(context.workspace,
+                         WorkspaceSlot::kHistogram,
+                         cv::Size{kHistogramSize, kHistogramSize},
+                         CV_64F);
+  if (params.guided_image.empty()) {
+    MakeJointHistogramWithMean(input, params.kernel_size, f, context.workspace);
   }
-
-  // Create 2D histogram
-  cv::Mat f;
-  {
-    const std::vector<cv::Mat> images({merged});
-    const std::vector<int> channels{{0, 1}};
-    const std::vector<int> histSize{{256, 256}};
-    const std::vector<float> ranges{
-      {kGrayscaleMin, kGrayscaleMax, kGrayscaleMin, kGrayscaleMax}};
-    cv::calcHist(images,
-                 channels,
-                 cv::noArray() /* no mask */,
-                 f,
-                 histSize,
-                 ranges,
-                 false /* disable accumulate old value from f */);
+  else {
+    MakeJointHistogram(input, params.guided_image, f, context.workspace);
   }
-  f.convertTo(f, CV_64F);
+
+  // cv::calcHist over the range [0, 255) used to build f, which drops the
+  // pixels at 255 of either image, kept so that the thresholds do not change
+  f.row(kHistogramSize - 1).setTo(0.0);
+  f.col(kHistogramSize - 1).setTo(0.0);
 
   // P = integral(f)
-  cv::Mat P;
+  auto P = AcquireBuffer(context.workspace,
+                         WorkspaceSlot::kHistogramIntegral,
+                         cv::Size{kHistogramSize + 1, kHistogramSize + 1},
+                         CV_64F);
   cv::integral(f,
                P,
                CV_64F   // Force to store double in P
   );
 
+  auto temp = AcquireBuffer(context.workspace,
+                            WorkspaceSlot::kWeightedHistogram,
+                            f.size(),
+                            CV_64F);
+
   // X = integral([[0], [1], [2], ... [255]] * f)
-  cv::Mat X;
+  auto X = AcquireBuffer(context.workspace,
+                         WorkspaceSlot::kRowMomentIntegral,
+                         P.size(),
+                         CV_64F);
   {
-    cv::Mat temp = f.clone();
+    f.copyTo(temp);
     temp.forEach<double>([](double& pixel, const int* position) {
       pixel *= position[0];
     });
@@ -80,56 +320,24 @@ void Otsu2D::BinarizeUnsafe(const cv::Mat& input,
   }
 
   // Y = integral(f * [0, 1, 2, 3, ..., 255])
-  cv::Mat Y;
+  auto Y = AcquireBuffer(context.workspace,
+                         WorkspaceSlot::kColumnMomentIntegral,
+                         P.size(),
+                         CV_64F);
   {
-    cv::Mat temp = f.clone();
+    f.copyTo(temp);
     temp.forEach<double>([](double& pixel, const int* position) {
       pixel *= position[1];
     });
     cv::integral(temp, Y, CV_64F /* Force to store double in P */);
   }
 
-  auto threshold_s  = softdouble::zero();
-  auto threshold_t  = softdouble::zero();
-  auto max_retrance = softdouble::zero();
-
-  for (auto s = 0; s < f.rows; ++s) {
-    for (auto t = 0; t < f.cols; ++t) {
-      const auto y = s + 1;
-      const auto x = t + 1;
-
-      const softdouble X0{*X.ptr<double>(y, x)};
-      const softdouble Y0{*Y.ptr<double>(y, x)};
-
-      const softdouble X1{*X.ptr<double>(256, 256) - *X.ptr<double>(256, x) -
-                          *X.ptr<double>(y, 256) + X0};
-      const softdouble Y1{*Y.ptr<double>(256, 256) - *Y.ptr<double>(256, x) -
-                          *Y.ptr<double>(y, 256) + Y0};
-
-      const softdouble w0{*P.ptr<double>(y, x)};
-      if (!(w0 > softdouble::eps())) {
-        continue;
-      }
-
-      const softdouble w1{*P.ptr<double>(256, 256) - *P.ptr<double>(256, x) -
-                          *P.ptr<double>(y, 256) + *P.ptr<double>(y, x)};
-      if (!(w1 > softdouble::eps())) {
-        break;
-      }
-
-      const auto u0 = (X0 + Y0) / (w0 + w0);
-      const auto u1 = (X1 + Y1) / (w1 + w1);
-      const auto ut = w0 * u0 + w1 * u1;
-
-      if (const auto local_retrance =
-            w0 * (ut - u0) * (ut - u0) + w1 * (ut - u1) * (ut - u1);
-          local_retrance > max_retrance) {
-        max_retrance = local_retrance;
-        threshold_s  = softdouble{s};
-        threshold_t  = softdouble{t};
-      }
-    }
-  }
+  const auto [threshold_s, threshold_t] =
+    params.threshold_search == ThresholdSearch::kDecomposed
+      ? SearchDecomposed(P, X, Y)
+      : (context.execution_mode == ExecutionMode::kFast
+           ? SearchExhaustiveFast(P, X, Y)
+           : SearchExhaustiveReference(P, X, Y));
 
   //  Given an arbitrary threshold pair(s, t), the 2D histogram can be divided
   //  into four regions.Regions A and C represent object and background
@@ -151,7 +359,7 @@ void Otsu2D::BinarizeUnsafe(const cv::Mat& input,
   const auto threshold =
     // object: A, background: edge(B) + C + noise(D) ~ threshold = max(s,t)
     params.edge_role_as_background && params.noise_role_as_background
-      ? cv::max(threshold_s, threshold_t)
+      ? std::max(threshold_s, threshold_t)
       // object: A + noise(D), background: edge(B) + C ~ threshold = s
       : (params.edge_role_as_background
            ? threshold_s
@@ -160,15 +368,15 @@ void Otsu2D::BinarizeUnsafe(const cv::Mat& input,
                 ? threshold_t
                 // object: A + edge(B) + noise(D),
                 // background: C ~ threshold = min(s, t)
-                : cv::min(threshold_s, threshold_t)));
+                : std::min(threshold_s, threshold_t)));
 
-  cv::threshold(output,
+  // threshold is an integer, so comparing the 8-bit input directly gives the
+  // same result as comparing it as double
+  cv::threshold(input,
                 output,
                 static_cast<double>(threshold),
                 kGrayscaleMax,
                 use_background_white_color
                   ? cv::ThresholdTypes::THRESH_BINARY
                   : cv::ThresholdTypes::THRESH_BINARY_INV);
-
-  output.convertTo(output, CV_8U);
 }
@@ -7,10 +7,22 @@
 
 #include <opencv2/core.hpp>
 
+#include "imgproc/binarization/binarization_context.hpp"
+
 namespace longlp::imgproc {
 
   class Otsu2D final {
    public:
+    // How the threshold pair (s, t) is searched:
+    // - kExhaustive: every pair of the 2D histogram, exact
+    // - kDecomposed: s and t searched independently by 1D Otsu on the
+    //   histograms of the input and of the guided image, 512 candidates
+    //   instead of 65536, approximate
+    enum class ThresholdSearch {
+      kExhaustive,
+      kDecomposed,
+    };
+
     struct Params {
       cv::Size kernel_size{};
       bool edge_role_as_background{};    // treat detected edge as either
@@ -18,14 +30,19 @@ namespace longlp::imgproc {
       bool noise_role_as_background{};   // treat detected noise as either
                                          // background or foreground
 
-      cv::Mat
-        guided_image{};   // usually created with cv::blur to get average image
+      // usually the average image, i.e. cv::blur of the input over
+      // kernel_size with BORDER_REFLECT, which is built internally in the
+      // histogram pass when empty
+      cv::Mat guided_image{};
+
+      ThresholdSearch threshold_search{ThresholdSearch::kExhaustive};
     };
 
     auto BinarizeUnsafe(const cv::Mat& input,
                         cv::Mat& output,
                         bool use_background_white_color,
-                        const Params& params) const -> void;
+                        const Params& params,
+                        const BinarizationContext& context) const -> void;
 
     auto InvalidateParams(const cv::Mat& input, const Params& params) const
       -> void;
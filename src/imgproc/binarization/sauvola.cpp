@@ -4,23 +4,127 @@
 
 #include "imgproc/binarization/sauvola.hpp"
 
+#include <span>
+#include <vector>   // sweep thresholds
+
+#include <opencv2/core/hal/intrin.hpp>
 #include <opencv2/core/softfloat.hpp>
 
+#include "imgproc/common/chungkwong_chan_integral_image_calculator.hpp"
 #include "imgproc/common/constant.hpp"
 #include "imgproc/common/integral_image_calculator.hpp"
+#include "imgproc/common/local_sums.hpp"
+#include "imgproc/common/packed_binary_image.hpp"
+#include "imgproc/common/parameter_sweep.hpp"
+#include "imgproc/common/simd_row_kernels.hpp"
+#include "imgproc/common/threshold_grid.hpp"
+#include "imgproc/common/threshold_map.hpp"
 
 namespace {
+  using longlp::imgproc::BasicSauvola;
+  using longlp::imgproc::BinaryColorPair;
+  using longlp::imgproc::ChungkwongChanIntegralImageCalculator;
+  using longlp::imgproc::GrayscalePixel;
   using longlp::imgproc::IntegralImageCalculator;
-  using longlp::imgproc::Sauvola;
-  using KernelVertices = IntegralImageCalculator::KernelVertices;
-  using IntegralImages = IntegralImageCalculator::IntegralImages<2>;
+  using longlp::imgproc::LocalSums;
+  using longlp::imgproc::LocalSumsRows;
+  using longlp::imgproc::PackedBinaryImage;
+  using longlp::imgproc::ParameterSweep;
+  using longlp::imgproc::SweepScore;
+  using longlp::imgproc::ThresholdGrid;
+  using longlp::imgproc::WorkspaceSlot;
 
   using cv::softdouble;
   using ErrorCode = cv::Error::Code;
+
+  // threshold = mean * (1 + k * (stddev / r - 1)), with hardware doubles
+  struct FastThreshold {
+    double k;
+    double r;
+
+    auto operator()(const double mean, const double stddev) const noexcept
+      -> double {
+      return mean * (1.0 + k * (stddev / r - 1.0));
+    }
+
+#if CV_SIMD_64F
+    auto operator()(const cv::v_float64& mean,
+                    const cv::v_float64& stddev) const noexcept
+      -> cv::v_float64 {
+      const auto one = cv::vx_setall_f64(1.0);
+      return cv::v_mul(
+        mean,
+        cv::v_add(one,
+                  cv::v_mul(cv::vx_setall_f64(k),
+                            cv::v_sub(cv::v_div(stddev, cv::vx_setall_f64(r)),
+                                      one))));
+    }
+#endif
+  };
+
+  // threshold = mean * (1 + k * (stddev / r - 1)), with cv::softdouble
+  struct ReferenceDecision {
+    BinaryColorPair binary_colors;
+    softdouble N;
+    softdouble k;
+    softdouble r;
+
+    auto operator()(const GrayscalePixel pixel,
+                    const LocalSums<2>& local_sums) const -> GrayscalePixel {
+      const auto local_mean = softdouble{local_sums[0]} / N;
+
+      const auto local_stddev = cv::sqrt(softdouble{local_sums[1]} / N -
+                                         local_mean * local_mean);
+
+      const auto thresh_hold =
+        local_mean *
+        (softdouble::one() + k * (local_stddev / r - softdouble::one()));
+
+      return softdouble{pixel} > thresh_hold ? binary_colors.background
+                                             : binary_colors.object;
+    }
+  };
+
+  // Fast path of one row, instantiated per polarity
+  template <bool UseBackgroundWhiteColor, class Params>
+  void BinarizeRowFast(const GrayscalePixel* input,
+                       GrayscalePixel* output,
+                       const LocalSumsRows<2>& local_sums_rows,
+                       const size_t width,
+                       const Params& params) noexcept {
+    longlp::imgproc::simd::BinarizeRowWithMeanStddev<UseBackgroundWhiteColor>(
+      input,
+      output,
+      local_sums_rows,
+      width,
+      static_cast<double>(params.kernel_size.area()),
+      FastThreshold{params.k, params.r});
+  }
+
+  // FastThreshold of every params of a sweep
+  template <class Params>
+  auto MakeFastThresholds(std::span<const Params> params)
+    -> std::vector<FastThreshold> {
+    std::vector<FastThreshold> thresholds;
+    thresholds.reserve(params.size());
+    for (const auto& param : params) {
+      thresholds.push_back(FastThreshold{param.k, param.r});
+    }
+    return thresholds;
+  }
 }   // namespace
 
-auto Sauvola::InvalidateParams([[maybe_unused]] const cv::Mat& input,
-                               const Params& params) const -> void {
+// static
+template <class LocalSumsCalculator>
+auto BasicSauvola<LocalSumsCalculator>::GetKernelSize(
+  const Params& params) noexcept -> cv::Size {
+  return params.kernel_size;
+}
+
+template <class LocalSumsCalculator>
+auto BasicSauvola<LocalSumsCalculator>::InvalidateParams(
+  [[maybe_unused]] const cv::Mat& input,
+  const Params& params) const -> void {
   if (params.kernel_size.empty()) {
     CV_Error(ErrorCode::StsBadArg, "kernel size is empty");
   }
@@ -33,67 +137,227 @@ auto Sauvola::InvalidateParams([[maybe_unused]] const cv::Mat& input,
 }
 
 // https://sci-hub.se/https://doi.org/10.1016/S0031-3203(99)00055-2
-void Sauvola::BinarizeUnsafe(const cv::Mat& input,
-                             cv::Mat& output,
-                             const bool use_background_white_color,
-                             const Params& params) const {
-  output = input.clone();
-  output.convertTo(output, CV_64F);
-
+template <class LocalSumsCalculator>
+void BasicSauvola<LocalSumsCalculator>::BinarizeUnsafe(
+  const cv::Mat& input,
+  cv::Mat& output,
+  const bool use_background_white_color,
+  const Params& params,
+  const BinarizationContext& context) const {
   const auto binary_colors = use_background_white_color
                                ? BinaryColorPair::Get()
                                : BinaryColorPair::GetInverse();
 
-  IntegralImageCalculator::ConstructIntegralAndIterate<double, 2>(
+  output.create(input.size(), CV_8UC1);
+
+  if (context.grid_stride > 1) {
+    ThresholdGrid grid{input,
+                       params.kernel_size,
+                       context.grid_stride,
+                       false /* with min max */,
+                       context.workspace};
+    grid.ComputeThresholds(
+      [threshold = FastThreshold{params.k, params.r}](
+        const ThresholdGrid::Window& window) {
+        return threshold(window.mean(), window.stddev());
+      });
+    DispatchPolarity(use_background_white_color,
+                     [&grid, &output](auto use_background_white) {
+                       grid.Binarize<decltype(use_background_white)::value>(
+                         output);
+                     });
+    return;
+  }
+
+  if (context.execution_mode == ExecutionMode::kFast) {
+    DispatchPolarity(
+      use_background_white_color,
+      [&input, &output, &params, &context](auto use_background_white) {
+        constexpr auto kUseBackgroundWhite =
+          decltype(use_background_white)::value;
+        LocalSumsCalculator::template ConstructIntegralAndIterateRows<2>(
+          input,
+          params.kernel_size,
+          context.workspace,
+          [&input, &output, &params](const int y,
+                                     const LocalSumsRows<2>& local_sums_rows) {
+            BinarizeRowFast<kUseBackgroundWhite>(
+              input.ptr<GrayscalePixel>(y),
+              output.ptr<GrayscalePixel>(y),
+              local_sums_rows,
+              static_cast<size_t>(input.cols),
+              params);
+          });
+      });
+    return;
+  }
+
+  LocalSumsCalculator::template ConstructIntegralAndIterate<2>(
+    input,
     output,
     params.kernel_size,
-    [&binary_colors,
-     N = softdouble{params.kernel_size.area()},
-     k = softdouble{params.k},
-     r = softdouble{params.r}](double& pixel,
-                               [[maybe_unused]] const int* position,
-                               const IntegralImages& integral_images,
-                               const KernelVertices& kernel_vertices) {
-      const auto& [integral_1st_order, integral_2nd_order] = integral_images;
-
-      const softdouble i1i1{
-        *integral_1st_order.ptr<double>(kernel_vertices.bottom,
-                                        kernel_vertices.right)};
-      const softdouble i1i2{
-        *integral_1st_order.ptr<double>(kernel_vertices.top,
-                                        kernel_vertices.left)};
-      const softdouble i1i3{
-        *integral_1st_order.ptr<double>(kernel_vertices.bottom,
-                                        kernel_vertices.left)};
-      const softdouble i1i4{
-        *integral_1st_order.ptr<double>(kernel_vertices.top,
-                                        kernel_vertices.right)};
-
-      const auto local_mean = (i1i1 + i1i2 - i1i3 - i1i4) / N;
-
-      const softdouble i2i1{
-        *integral_2nd_order.ptr<double>(kernel_vertices.bottom,
-                                        kernel_vertices.right)};
-      const softdouble i2i2{
-        *integral_2nd_order.ptr<double>(kernel_vertices.top,
-                                        kernel_vertices.left)};
-      const softdouble i2i3{
-        *integral_2nd_order.ptr<double>(kernel_vertices.bottom,
-                                        kernel_vertices.left)};
-      const softdouble i2i4{
-        *integral_2nd_order.ptr<double>(kernel_vertices.top,
-                                        kernel_vertices.right)};
-
-      const auto local_stddev =
-        cv::sqrt((i2i1 + i2i2 - i2i3 - i2i4) / N - local_mean * local_mean);
+    context.workspace,
+    [decision = ReferenceDecision{binary_colors,
+                                  softdouble{params.kernel_size.area()},
+                                  softdouble{params.k},
+                                  softdouble{params.r}}](
+      const GrayscalePixel pixel,
+      [[maybe_unused]] const int* position,
+      const LocalSums<2>& local_sums) { return decision(pixel, local_sums); });
+}
 
-      const auto thresh_hold =
-        local_mean *
-        (softdouble::one() + k * (local_stddev / r - softdouble::one()));
+template <class LocalSumsCalculator>
+void BasicSauvola<LocalSumsCalculator>::ComputeThresholdMapUnsafe(
+  const cv::Mat& input,
+  cv::Mat& map,
+  const int map_type,
+  const Params& params,
+  const BinarizationContext& context) const {
+  map.create(input.size(), map_type);
+
+  DispatchMapType(map_type, [&input, &map, &params, &context](auto map_value) {
+    using MapValue = decltype(map_value);
+    LocalSumsCalculator::template ConstructIntegralAndIterateRows<2>(
+      input,
+      params.kernel_size,
+      context.workspace,
+      [&map, &params](const int y, const LocalSumsRows<2>& local_sums_rows) {
+        simd::ThresholdRowWithMeanStddev(
+          local_sums_rows,
+          map.ptr<MapValue>(y),
+          static_cast<size_t>(map.cols),
+          static_cast<double>(params.kernel_size.area()),
+          FastThreshold{params.k, params.r});
+      });
+  });
+}
+
+template <class LocalSumsCalculator>
+void BasicSauvola<LocalSumsCalculator>::BinarizePackedUnsafe(
+  const cv::Mat& input,
+  PackedBinaryImage& output,
+  const bool use_background_white_color,
+  const Params& params,
+  const BinarizationContext& context) const {
+  if (context.execution_mode != ExecutionMode::kFast ||
+      context.grid_stride > 1) {
+    // no packed kernel, the 8-bit output is packed afterwards
+    auto unpacked = AcquireBuffer(context.workspace,
+                                  WorkspaceSlot::kUnpackedOutput,
+                                  input.size(),
+                                  CV_8UC1);
+    BinarizeUnsafe(input,
+                   unpacked,
+                   use_background_white_color,
+                   params,
+                   context);
+    output.Pack(unpacked);
+    return;
+  }
 
-      pixel = softdouble{pixel} > thresh_hold ? binary_colors.background
-                                              : binary_colors.object;
+  output.Create(input.size());
+
+  DispatchPolarity(
+    use_background_white_color,
+    [&input, &output, &params, &context](auto use_background_white) {
+      constexpr auto kUseBackgroundWhite =
+        decltype(use_background_white)::value;
+      LocalSumsCalculator::template ConstructIntegralAndIterateRows<2>(
+        input,
+        params.kernel_size,
+        context.workspace,
+        [&input, &output, &params](const int y,
+                                   const LocalSumsRows<2>& local_sums_rows) {
+          simd::BinarizePackedRowWithMeanStddev<kUseBackgroundWhite>(
+            input.ptr<GrayscalePixel>(y),
+            output.bytes(y),
+            local_sums_rows,
+            static_cast<size_t>(input.cols),
+            static_cast<double>(params.kernel_size.area()),
+            FastThreshold{params.k, params.r});
+        });
     });
+}
+
+template <class LocalSumsCalculator>
+void BasicSauvola<LocalSumsCalculator>::SweepUnsafe(
+  const cv::Mat& input,
+  std::span<cv::Mat> outputs,
+  const bool use_background_white_color,
+  std::span<const Params> params,
+  const BinarizationContext& context) const {
+  const auto thresholds = MakeFastThresholds(params);
+  const ParameterSweep<LocalSumsCalculator> sweep{input,
+                                                  params.front().kernel_size,
+                                                  context.workspace};
 
-  output.convertTo(output, CV_8U);
+  DispatchPolarity(
+    use_background_white_color,
+    [&sweep, &thresholds, &outputs](auto use_background_white) {
+      sweep.template Binarize<decltype(use_background_white)::value>(
+        std::span<const FastThreshold>{thresholds},
+        outputs);
+    });
 }
+
+template <class LocalSumsCalculator>
+void BasicSauvola<LocalSumsCalculator>::ScoreSweepUnsafe(
+  const cv::Mat& input,
+  const cv::Mat& ground_truth,
+  std::span<SweepScore> scores,
+  std::span<const Params> params,
+  const BinarizationContext& context) const {
+  const auto thresholds = MakeFastThresholds(params);
+  const ParameterSweep<LocalSumsCalculator> sweep{input,
+                                                  params.front().kernel_size,
+                                                  context.workspace};
+
+  sweep.Score(std::span<const FastThreshold>{thresholds},
+              ground_truth,
+              scores);
+}
+
+template <class LocalSumsCalculator>
+void BasicSauvola<LocalSumsCalculator>::BinarizeRowUnsafe(
+  const cv::Mat& rows,
+  const int row,
+  const LocalSumsRows<kLocalSumsOrder>& local_sums_rows,
+  GrayscalePixel* output,
+  const bool use_background_white_color,
+  const Params& params,
+  const BinarizationContext& context) const {
+  const auto binary_colors = use_background_white_color
+                               ? BinaryColorPair::Get()
+                               : BinaryColorPair::GetInverse();
+
+  const auto* input = rows.ptr<GrayscalePixel>(row);
+  const auto width  = static_cast<size_t>(rows.cols);
+
+  if (context.execution_mode == ExecutionMode::kFast) {
+    DispatchPolarity(
+      use_background_white_color,
+      [input, output, &local_sums_rows, &width, &params](
+        auto use_background_white) {
+        BinarizeRowFast<decltype(use_background_white)::value>(
+          input,
+          output,
+          local_sums_rows,
+          width,
+          params);
+      });
+    return;
+  }
+
+  const ReferenceDecision decision{binary_colors,
+                                   softdouble{params.kernel_size.area()},
+                                   softdouble{params.k},
+                                   softdouble{params.r}};
+  const auto& [sums, square_sums] = local_sums_rows;
+  for (size_t x = 0; x < width; ++x) {
+    output[x] = decision(input[x], LocalSums<2>{sums[x], square_sums[x]});
+  }
+}
+
+template class longlp::imgproc::BasicSauvola<IntegralImageCalculator>;
+template class longlp::imgproc::BasicSauvola<
+  ChungkwongChanIntegralImageCalculator>;
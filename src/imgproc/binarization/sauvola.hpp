@@ -5,10 +5,25 @@
 #ifndef IMGPROC_BINARIZATION_SAUVOLA_HPP_
 #define IMGPROC_BINARIZATION_SAUVOLA_HPP_
 
+#include <cstddef>
+#include <span>
+
 #include <opencv2/core.hpp>
 
+#include "imgproc/binarization/binarization_context.hpp"
+#include "imgproc/common/constant.hpp"
+#include "imgproc/common/local_sums.hpp"
+
 namespace longlp::imgproc {
-  class Sauvola final {
+  class IntegralImageCalculator;
+  class ChungkwongChanIntegralImageCalculator;
+  class PackedBinaryImage;
+  struct SweepScore;
+
+  // |LocalSumsCalculator| computes the local mean and standard deviation,
+  // either IntegralImageCalculator or ChungkwongChanIntegralImageCalculator
+  template <class LocalSumsCalculator>
+  class BasicSauvola final {
    public:
     struct Params {
       // size area must be > 0
@@ -19,15 +34,80 @@ namespace longlp::imgproc {
       // must be in range [0.0 - 255.0]
       double r{};
     };
+
+    // Size of the neighborhood each output pixel depends on
+    static auto GetKernelSize(const Params& params) noexcept -> cv::Size;
+
+    // Order of the local sums given to BinarizeRowUnsafe
+    static constexpr size_t kLocalSumsOrder = 2;
+
     auto BinarizeUnsafe(const cv::Mat& input,
                         cv::Mat& output,
                         bool use_background_white_color,
-                        const Params& params) const -> void;
+                        const Params& params,
+                        const BinarizationContext& context) const -> void;
+
+    // Local threshold of every pixel of |input| as a threshold map of
+    // |map_type|, CV_8UC1 or CV_32FC1, see ApplyThresholdMap. Computed with
+    // hardware doubles whatever the execution mode and grid stride: applying
+    // a CV_32FC1 map gives the kFast output.
+    auto ComputeThresholdMapUnsafe(const cv::Mat& input,
+                                   cv::Mat& map,
+                                   int map_type,
+                                   const Params& params,
+                                   const BinarizationContext& context) const
+      -> void;
+
+    // Same as BinarizeUnsafe, with |output| packed to one bit per pixel. The
+    // kFast execution mode packs the rows as they are decided.
+    auto BinarizePackedUnsafe(const cv::Mat& input,
+                              PackedBinaryImage& output,
+                              bool use_background_white_color,
+                              const Params& params,
+                              const BinarizationContext& context) const
+      -> void;
+
+    // Binarizes |input| into outputs[i] with params[i] for every params, as
+    // BinarizeUnsafe in kFast mode, from one set of local statistics, see
+    // ParameterSweep. |params| is not empty and every params has the same
+    // kernel size.
+    auto SweepUnsafe(const cv::Mat& input,
+                     std::span<cv::Mat> outputs,
+                     bool use_background_white_color,
+                     std::span<const Params> params,
+                     const BinarizationContext& context) const -> void;
+
+    // scores[i] of the binarization of |input| with params[i] against
+    // |ground_truth|, which may be empty, see SweepUnsafe
+    auto ScoreSweepUnsafe(const cv::Mat& input,
+                          const cv::Mat& ground_truth,
+                          std::span<SweepScore> scores,
+                          std::span<const Params> params,
+                          const BinarizationContext& context) const -> void;
+
+    // Binarizes the row |row| of |rows| into |output|: |rows| are consecutive
+    // input rows holding the kernel window of |row| clipped to the image, and
+    // |local_sums_rows| are the local sums of |row|
+    auto BinarizeRowUnsafe(
+      const cv::Mat& rows,
+      int row,
+      const LocalSumsRows<kLocalSumsOrder>& local_sums_rows,
+      GrayscalePixel* output,
+      bool use_background_white_color,
+      const Params& params,
+      const BinarizationContext& context) const -> void;
 
     auto InvalidateParams(const cv::Mat& input, const Params& params) const
       -> void;
   };
 
+  extern template class BasicSauvola<IntegralImageCalculator>;
+  extern template class BasicSauvola<ChungkwongChanIntegralImageCalculator>;
+
+  using Sauvola = BasicSauvola<IntegralImageCalculator>;
+  using ChungkwongChanSauvola =
+    BasicSauvola<ChungkwongChanIntegralImageCalculator>;
+
 }   // namespace longlp::imgproc
 
 #endif   // IMGPROC_BINARIZATION_SAUVOLA_HPP_
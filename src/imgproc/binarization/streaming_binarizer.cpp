@@ -0,0 +1,5 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/binarization/streaming_binarizer.hpp"
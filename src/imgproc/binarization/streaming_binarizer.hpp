@@ -0,0 +1,263 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_BINARIZATION_STREAMING_BINARIZER_HPP_
+#define IMGPROC_BINARIZATION_STREAMING_BINARIZER_HPP_
+
+#include <algorithm>   // std::max, std::min, std::fill
+#include <array>       // running sums
+#include <concepts>
+#include <cstddef>
+#include <functional>   // RowCallback
+#include <utility>      // std::move
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/binarization/binarization_context.hpp"
+#include "imgproc/binarization/binarization_validator.hpp"
+#include "imgproc/binarization/tiled_binarization_algorithm.hpp"
+#include "imgproc/common/binarization_workspace.hpp"
+#include "imgproc/common/constant.hpp"
+#include "imgproc/common/local_sums.hpp"
+
+namespace longlp::imgproc {
+
+  // Local methods which can binarize one row from its kernel window
+  template <class T>
+  concept StreamingBinarizationMethodInterface =
+    LocalBinarizationMethodInterface<T> &&
+    requires(const T& t,
+             const cv::Mat& rows,
+             const int row,
+             const LocalSumsRows<T::kLocalSumsOrder>& local_sums_rows,
+             GrayscalePixel* output,
+             const bool use_background_white_color,
+             const typename T::Params& params,
+             const BinarizationContext& context) {
+    {
+      t.BinarizeRowUnsafe(rows,
+                          row,
+                          local_sums_rows,
+                          output,
+                          use_background_white_color,
+                          params,
+                          context)
+      } -> std::same_as<void>;
+  };
+
+  // Push-based binarization of pages delivered row by row, e.g. by a scanner.
+  // The output row y is emitted once the input row y + latency() has been
+  // pushed, and is identical to the row y of BinarizationAlgorithm on the
+  // whole page.
+  //
+  // Only the last kernel height rows are kept, in a ring buffer, along with
+  // running sums of every column over the rows of the kernel window, so
+  // memory is proportional to the width times the kernel height.
+  template <StreamingBinarizationMethodInterface MethodType>
+  class StreamingBinarizer {
+   public:
+    using Params = typename MethodType::Params;
+
+    // |output_row| is a 1 x width 8-bit image, only valid during the call
+    using RowCallback = std::function<void(int y, const cv::Mat& output_row)>;
+
+    StreamingBinarizer(
+      const int width,
+      const bool use_background_white_color,
+      const Params& params,
+      RowCallback on_row,
+      const ExecutionMode execution_mode = ExecutionMode::kReference) :
+      width_{width},
+      use_background_white_color_{use_background_white_color},
+      params_{params},
+      on_row_{std::move(on_row)},
+      execution_mode_{execution_mode},
+      kernel_size_{MethodType::GetKernelSize(params)} {
+      // pre-conditions
+      if (width <= 0) {
+        CV_Error(cv::Error::Code::StsBadArg, "width must be positive");
+      }
+      if (kernel_size_.empty()) {
+        CV_Error(cv::Error::Code::StsBadArg, "kernel size is empty");
+      }
+      if (!on_row_) {
+        CV_Error(cv::Error::Code::StsBadArg, "row callback is empty");
+      }
+      // rows are not known yet
+      BinarizationValidator<MethodType>::ValidateParams(method_,
+                                                        cv::Mat{},
+                                                        params_);
+
+      delta_x_ = (kernel_size_.width - 1) / 2;
+      delta_y_ = (kernel_size_.height - 1) / 2;
+
+      // every row is stored twice, so that any kernel height consecutive
+      // rows are contiguous
+      ring_.create(2 * kernel_size_.height, width_, CV_8UC1);
+
+      column_indices_.resize(static_cast<size_t>(width_ + 2 * delta_x_));
+      for (size_t i = 0; i < column_indices_.size(); ++i) {
+        column_indices_[i] = static_cast<size_t>(
+          cv::borderInterpolate(static_cast<int>(i) - delta_x_,
+                                width_,
+                                cv::BorderTypes::BORDER_REFLECT));
+      }
+
+      const auto size = static_cast<size_t>(width_);
+      for (size_t order = 0; order < kOrder; ++order) {
+        column_sums_[order].resize(size);
+        sums_[order].resize(size);
+        local_sums_rows_[order] = sums_[order].data();
+      }
+      row_prefix_.resize(column_indices_.size() + 1);
+
+      output_row_.create(1, width_, CV_8UC1);
+    }
+
+    // local_sums_rows_ points into sums_
+    StreamingBinarizer(const StreamingBinarizer&) = delete;
+    auto operator=(const StreamingBinarizer&) -> StreamingBinarizer& = delete;
+    StreamingBinarizer(StreamingBinarizer&&) noexcept = default;
+    auto operator=(StreamingBinarizer&&) noexcept
+      -> StreamingBinarizer& = default;
+    ~StreamingBinarizer() = default;
+
+    // Feeds the next row of the page, a 1 x width 8-bit image
+    void PushRow(const cv::Mat& row) {
+      // pre-conditions
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (row.type() != CV_8UC1 || row.rows != 1 || row.cols != width_) {
+        CV_Error(cv::Error::Code::StsBadArg,
+                 "row must be 1 x width, 8-bit, single channel");
+      }
+
+      const auto slot = rows_pushed_ % kernel_size_.height;
+      row.copyTo(ring_.row(slot));
+      row.copyTo(ring_.row(slot + kernel_size_.height));
+      ++rows_pushed_;
+
+      while (next_row_ + delta_y_ < rows_pushed_) {
+        EmitRow(next_row_++, rows_pushed_);
+      }
+    }
+
+    // Ends the page: the remaining rows are emitted, reflected at the bottom
+    // of the page, then the binarizer is ready for the next page
+    void Finish() {
+      const auto height = rows_pushed_;
+      while (next_row_ < height) {
+        EmitRow(next_row_++, height);
+      }
+      rows_pushed_ = 0;
+      next_row_    = 0;
+    }
+
+    // Number of rows pushed after an input row before its output is emitted
+    [[nodiscard]] auto latency() const noexcept -> int {
+      return delta_y_;
+    }
+
+   private:
+    static constexpr auto kOrder = MethodType::kLocalSumsOrder;
+
+    // Same window as the local sums calculators: rows in
+    // [y - delta_y + 1, y + delta_y] and columns in
+    // [x - delta_x + 1, x + delta_x], reflected at the edges of the page.
+    // Rows of the page above |height| are not pushed yet.
+    void EmitRow(const int y, const int height) {
+      if (y == 0) {
+        for (auto& column_sum : column_sums_) {
+          std::fill(column_sum.begin(), column_sum.end(), 0.0);
+        }
+        for (auto i = -delta_y_ + 1; i <= delta_y_; ++i) {
+          AccumulateRow(i, height, 1.0);
+        }
+      }
+      else {
+        AccumulateRow(y + delta_y_, height, 1.0);
+        AccumulateRow(y - delta_y_, height, -1.0);
+      }
+
+      const auto first = size_t{1};
+      const auto last  = 2 * static_cast<size_t>(delta_x_) + 1;
+      for (size_t order = 0; order < kOrder; ++order) {
+        const auto& column_sum = column_sums_[order];
+        for (size_t i = 0; i < column_indices_.size(); ++i) {
+          row_prefix_[i + 1] = row_prefix_[i] + column_sum[column_indices_[i]];
+        }
+
+        auto& sums = sums_[order];
+        for (size_t x = 0; x < sums.size(); ++x) {
+          sums[x] = row_prefix_[x + last] - row_prefix_[x + first];
+        }
+      }
+
+      // rows of the kernel window of y, clipped to the page, always among the
+      // last kernel height rows pushed
+      const auto first_row = std::max(0, y - kernel_size_.height / 2);
+      const auto last_row  = std::min(height - 1, y + delta_y_);
+      const cv::Mat window{last_row - first_row + 1,
+                           width_,
+                           CV_8UC1,
+                           ring_.ptr(first_row % kernel_size_.height),
+                           ring_.step};
+
+      method_.BinarizeRowUnsafe(
+        window,
+        y - first_row,
+        local_sums_rows_,
+        output_row_.ptr<GrayscalePixel>(0),
+        use_background_white_color_,
+        params_,
+        BinarizationContext{execution_mode_, &workspace_});
+
+      on_row_(y, output_row_);
+    }
+
+    // column_sums_[order] += sign * I^(order + 1) for the row |y| of the page
+    void AccumulateRow(const int y, const int height, const double sign) {
+      const auto slot =
+        cv::borderInterpolate(y, height, cv::BorderTypes::BORDER_REFLECT) %
+        kernel_size_.height;
+      const auto* pixels = ring_.ptr<GrayscalePixel>(slot);
+
+      for (size_t x = 0; x < static_cast<size_t>(width_); ++x) {
+        const double value = pixels[x];
+
+        auto power = sign;
+        for (size_t order = 0; order < kOrder; ++order) {
+          power *= value;
+          column_sums_[order][x] += power;
+        }
+      }
+    }
+
+    MethodType method_{};
+    int width_;
+    bool use_background_white_color_;
+    Params params_;
+    RowCallback on_row_;
+    ExecutionMode execution_mode_;
+    BinarizationWorkspace workspace_{};
+
+    cv::Size kernel_size_;
+    int delta_x_{};
+    int delta_y_{};
+
+    int rows_pushed_{0};
+    int next_row_{0};
+
+    cv::Mat ring_;
+    std::vector<size_t> column_indices_;
+    std::array<std::vector<double>, kOrder> column_sums_{};
+    std::vector<double> row_prefix_;
+    std::array<std::vector<double>, kOrder> sums_{};
+    LocalSumsRows<kOrder> local_sums_rows_{};
+    cv::Mat output_row_;
+  };
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_BINARIZATION_STREAMING_BINARIZER_HPP_
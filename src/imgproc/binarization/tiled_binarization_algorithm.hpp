@@ -0,0 +1,150 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_BINARIZATION_TILED_BINARIZATION_ALGORITHM_HPP_
+#define IMGPROC_BINARIZATION_TILED_BINARIZATION_ALGORITHM_HPP_
+
+#include <algorithm>   // std::max, std::min
+#include <concepts>
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/binarization/binarization_algorithm.hpp"
+#include "imgproc/binarization/binarization_context.hpp"
+#include "imgproc/common/binarization_workspace.hpp"
+#include "imgproc/common/mat_overlap.hpp"
+
+namespace longlp::imgproc {
+
+  // Methods whose output pixel only depends on the input pixels of a kernel
+  // window around it (NiBlack, Sauvola, Bernsen), unlike global methods such
+  // as Otsu2D
+  template <class T>
+  concept LocalBinarizationMethodInterface =
+    BinarizationMethodInterface<T> &&
+    requires(const typename T::Params& params) {
+    { T::GetKernelSize(params) } -> std::same_as<cv::Size>;
+  };
+
+  // Binarizes the input tile by tile, tiles are processed in parallel, each
+  // one with its own local sums, so that peak memory is bounded by the tile
+  // size times the number of threads instead of the image size.
+  //
+  // Every tile is extended by a halo of the kernel size on each side, clipped
+  // to the image, and only its core is written back: the kernel window of a
+  // core pixel never reaches the edges of the tile except where they are the
+  // edges of the image, so the output is identical to BinarizationAlgorithm.
+  template <LocalBinarizationMethodInterface MethodType>
+  class TiledBinarizationAlgorithm {
+   public:
+    using Params = typename MethodType::Params;
+
+    // Each dimension of |tile_size| that is not positive spans the whole
+    // image, e.g. {0, 256} splits the image into strips of 256 rows
+    explicit TiledBinarizationAlgorithm(
+      const cv::Size& tile_size,
+      const ExecutionMode execution_mode = ExecutionMode::kReference) :
+      algorithm_{execution_mode},
+      tile_size_{tile_size} {}
+
+    void Binarize(const cv::Mat& input,
+                  cv::Mat& output,
+                  const bool use_background_white_color,
+                  const Params& params) const {
+      // pre-conditions
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (input.type() != CV_8UC1 || input.dims != 2) {
+        CV_Error(
+          cv::Error::Code::StsBadArg,
+          "input is not binary image (8-bit, single channel, 2 dimension)");
+      }
+      const auto kernel_size = MethodType::GetKernelSize(params);
+      if (kernel_size.empty()) {
+        CV_Error(cv::Error::Code::StsBadArg, "kernel size is empty");
+      }
+
+      // tiles read the halo of their neighbors, |output| must not alias it
+      const cv::Mat source = input;
+      if (SharesData(source, output)) {
+        output.release();
+      }
+      output.create(source.size(), CV_8UC1);
+
+      const cv::Size tile_size{
+        tile_size_.width > 0 ? std::min(tile_size_.width, source.cols)
+                             : source.cols,
+        tile_size_.height > 0 ? std::min(tile_size_.height, source.rows)
+                              : source.rows};
+      const auto halo = std::max(kernel_size.width, kernel_size.height);
+
+      const auto tile_columns =
+        (source.cols + tile_size.width - 1) / tile_size.width;
+      const auto tile_rows =
+        (source.rows + tile_size.height - 1) / tile_size.height;
+      const auto tile_count = tile_columns * tile_rows;
+
+      // Tiles of a stripe run one after another on the same thread and share
+      // its buffers, the per-tile calls of |algorithm_| run serially inside
+      // it since OpenCV does not nest parallel regions
+      const auto stripe_count = std::min(cv::getNumThreads(), tile_count);
+      cv::parallel_for_(
+        cv::Range{0, tile_count},
+        [this,
+         &source,
+         &output,
+         &use_background_white_color,
+         &params,
+         &tile_size,
+         &tile_columns,
+         &halo](const cv::Range& tiles) {
+          BinarizationWorkspace workspace;
+          cv::Mat tile_input;
+          cv::Mat tile_output;
+
+          for (auto tile = tiles.start; tile < tiles.end; ++tile) {
+            const cv::Rect core{(tile % tile_columns) * tile_size.width,
+                                (tile / tile_columns) * tile_size.height,
+                                tile_size.width,
+                                tile_size.height};
+            const auto clipped_core =
+              core & cv::Rect{0, 0, source.cols, source.rows};
+
+            const auto region = cv::Rect{clipped_core.x - halo,
+                                         clipped_core.y - halo,
+                                         clipped_core.width + 2 * halo,
+                                         clipped_core.height + 2 * halo} &
+                                cv::Rect{0, 0, source.cols, source.rows};
+
+            // copied, so that the tile is padded as an image on its own
+            source(region).copyTo(tile_input);
+
+            algorithm_.Binarize(tile_input,
+                                tile_output,
+                                use_background_white_color,
+                                params,
+                                workspace);
+
+            tile_output(clipped_core - region.tl())
+              .copyTo(output(clipped_core));
+          }
+        },
+        static_cast<double>(stripe_count));
+    }
+
+    [[nodiscard]] auto execution_mode() const noexcept -> ExecutionMode {
+      return algorithm_.execution_mode();
+    }
+
+    [[nodiscard]] auto tile_size() const noexcept -> cv::Size {
+      return tile_size_;
+    }
+
+   private:
+    BinarizationAlgorithm<MethodType> algorithm_;
+    cv::Size tile_size_;
+  };
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_BINARIZATION_TILED_BINARIZATION_ALGORITHM_HPP_
@@ -0,0 +1,52 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/common/binarization_stats.hpp"
+
+#include <fmt/format.h>
+
+namespace {
+  using longlp::imgproc::BinarizationStage;
+  using longlp::imgproc::BinarizationStats;
+
+  constexpr std::array<const char*,
+                       static_cast<size_t>(BinarizationStage::kCount)>
+    kStageNames{
+      "validation",
+      "method",
+      "integral_image",
+      "traversal",
+      "morphology",
+    };
+}   // namespace
+
+void BinarizationStats::Merge(const BinarizationStats& other) noexcept {
+  for (size_t stage = 0; stage < stages_.size(); ++stage) {
+    stages_[stage].calls += other.stages_[stage].calls;
+    stages_[stage].wall_nanoseconds += other.stages_[stage].wall_nanoseconds;
+    stages_[stage].bytes_allocated += other.stages_[stage].bytes_allocated;
+    stages_[stage].pixels += other.stages_[stage].pixels;
+  }
+}
+
+void BinarizationStats::Reset() noexcept {
+  stages_.fill({});
+}
+
+auto BinarizationStats::ToJson() const -> std::string {
+  std::string json{"{"};
+  for (size_t stage = 0; stage < stages_.size(); ++stage) {
+    const auto& stats = stages_[stage];
+    json += fmt::format(
+      "{}\"{}\": {{\"calls\": {}, \"wall_ns\": {}, \"bytes_allocated\": {}, "
+      "\"pixels\": {}}}",
+      stage == 0 ? "" : ", ",
+      kStageNames[stage],
+      stats.calls,
+      stats.wall_nanoseconds,
+      stats.bytes_allocated,
+      stats.pixels);
+  }
+  return json + "}";
+}
@@ -0,0 +1,136 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_BINARIZATION_STATS_HPP_
+#define IMGPROC_COMMON_BINARIZATION_STATS_HPP_
+
+#include <array>   // stages_
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Stage timers are compiled in only when defined to 1, they cost nothing
+// otherwise
+#ifndef LONGLP_IMGPROC_INSTRUMENTATION
+  #define LONGLP_IMGPROC_INSTRUMENTATION 0
+#endif
+
+namespace longlp::imgproc {
+
+  inline constexpr bool kInstrumentationEnabled =
+    LONGLP_IMGPROC_INSTRUMENTATION != 0;
+
+  enum class BinarizationStage : uint8_t {
+    // checks of the input and params by BinarizationAlgorithm
+    kValidation,
+
+    // whole call of the method, including the stages below
+    kMethod,
+
+    kIntegralImage,
+
+    // local sums and decision of every pixel
+    kTraversal,
+
+    // min and max filters of Bernsen
+    kMorphology,
+
+    kCount,
+  };
+
+  struct StageStats {
+    uint64_t calls;
+    int64_t wall_nanoseconds;
+    uint64_t bytes_allocated;
+    uint64_t pixels;
+  };
+
+  // Per-stage wall time, bytes allocated and pixels processed of the
+  // binarizations run with a BinarizationWorkspace this is attached to, see
+  // BinarizationWorkspace::set_stats. Not thread-safe, as the workspace;
+  // the stats of several threads are summed with Merge.
+  class BinarizationStats {
+   public:
+    [[nodiscard]] auto operator[](const BinarizationStage stage) const
+      -> const StageStats& {
+      return stages_[static_cast<size_t>(stage)];
+    }
+
+    // Adds |bytes| to the innermost stage being timed, if any
+    void AddAllocation(const size_t bytes) noexcept {
+      if (active_stage_ != BinarizationStage::kCount) {
+        stages_[static_cast<size_t>(active_stage_)].bytes_allocated += bytes;
+      }
+    }
+
+    void Merge(const BinarizationStats& other) noexcept;
+
+    void Reset() noexcept;
+
+    // {"validation": {"calls": 1, "wall_ns": 1200, "bytes_allocated": 0,
+    // "pixels": 1240533}, "method": {...}, ...}
+    [[nodiscard]] auto ToJson() const -> std::string;
+
+   private:
+    friend class ScopedStageTimer;
+
+    std::array<StageStats, static_cast<size_t>(BinarizationStage::kCount)>
+      stages_{};
+    BinarizationStage active_stage_{BinarizationStage::kCount};
+  };
+
+  // Times |stage| from construction to destruction into |stats| when it is
+  // not null. Nested timers attribute the allocations to the innermost
+  // stage, the wall time of each stage includes its nested ones.
+  class ScopedStageTimer {
+   public:
+    ScopedStageTimer(const ScopedStageTimer&)                    = delete;
+    auto operator=(const ScopedStageTimer&) -> ScopedStageTimer& = delete;
+
+#if LONGLP_IMGPROC_INSTRUMENTATION
+    ScopedStageTimer(BinarizationStats* stats,
+                     const BinarizationStage stage,
+                     const uint64_t pixels) noexcept :
+      stats_{stats},
+      stage_{stage} {
+      if (stats_ == nullptr) {
+        return;
+      }
+      auto& stage_stats = stats_->stages_[static_cast<size_t>(stage)];
+      ++stage_stats.calls;
+      stage_stats.pixels += pixels;
+
+      parent_stage_         = stats_->active_stage_;
+      stats_->active_stage_ = stage;
+      start_                = std::chrono::steady_clock::now();
+    }
+
+    ~ScopedStageTimer() {
+      if (stats_ == nullptr) {
+        return;
+      }
+      stats_->stages_[static_cast<size_t>(stage_)].wall_nanoseconds +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start_)
+          .count();
+      stats_->active_stage_ = parent_stage_;
+    }
+
+   private:
+    BinarizationStats* stats_;
+    BinarizationStage stage_;
+    BinarizationStage parent_stage_{BinarizationStage::kCount};
+    std::chrono::steady_clock::time_point start_{};
+#else
+    constexpr ScopedStageTimer(
+      [[maybe_unused]] BinarizationStats* stats,
+      [[maybe_unused]] const BinarizationStage stage,
+      [[maybe_unused]] const uint64_t pixels) noexcept {}
+#endif
+  };
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_BINARIZATION_STATS_HPP_
@@ -0,0 +1,55 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/common/binarization_workspace.hpp"
+
+namespace {
+  using longlp::imgproc::BinarizationWorkspace;
+  using longlp::imgproc::WorkspaceSlot;
+
+  using ErrorCode = cv::Error::Code;
+}   // namespace
+
+auto BinarizationWorkspace::Acquire(const WorkspaceSlot slot,
+                                    const cv::Size& size,
+                                    const int type) -> cv::Mat {
+  // pre-conditions
+  if (slot >= WorkspaceSlot::kCount) {
+    CV_Error(ErrorCode::StsOutOfRange, "invalid workspace slot");
+  }
+  if (size.width < 0 || size.height < 0) {
+    CV_Error(ErrorCode::StsBadArg, "size must not be negative");
+  }
+
+  auto& buffer = buffers_[static_cast<size_t>(slot)];
+
+  const auto bytes = static_cast<size_t>(size.area()) * CV_ELEM_SIZE(type);
+  if (bytes <= buffer.total()) {
+    ++reuse_hits_;
+  }
+  else {
+    buffer.release();
+    buffer.create(1, static_cast<int>(bytes), CV_8UC1);
+    if (stats_ != nullptr) {
+      stats_->AddAllocation(bytes);
+    }
+  }
+
+  // header over the buffer, does not allocate
+  return cv::Mat{size, type, buffer.data};
+}
+
+void BinarizationWorkspace::Release() noexcept {
+  for (auto& buffer : buffers_) {
+    buffer.release();
+  }
+}
+
+auto BinarizationWorkspace::bytes_reserved() const noexcept -> size_t {
+  size_t bytes = 0;
+  for (const auto& buffer : buffers_) {
+    bytes += buffer.total();
+  }
+  return bytes;
+}
@@ -0,0 +1,117 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_BINARIZATION_WORKSPACE_HPP_
+#define IMGPROC_COMMON_BINARIZATION_WORKSPACE_HPP_
+
+#include <array>   // buffers_
+#include <cstddef>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/binarization_stats.hpp"
+
+namespace longlp::imgproc {
+
+  // Temporaries of a binarization call, each one owns its own buffer
+  enum class WorkspaceSlot : uint8_t {
+    // local sums calculators
+    kIntegralImage,
+    kSquareIntegralImage,
+    kColumnIndices,
+    kStripeBuffers,
+    kBorderRows,
+
+    // Bernsen
+    kMinFilter,
+    kMaxFilter,
+    kStructuringElementChords,
+    kMinMaxFilterBuffers,
+
+    // Otsu2D
+    kStripeHistograms,
+    kMeanRows,
+    kHistogram,
+    kWeightedHistogram,
+    kHistogramIntegral,
+    kRowMomentIntegral,
+    kColumnMomentIntegral,
+
+    // ThresholdGrid
+    kGridBlocks,
+    kGridWindows,
+    kGridThresholds,
+    kGridColumnWeights,
+
+    // ParameterSweep
+    kLocalMeans,
+    kLocalStddevs,
+
+    // 8-bit output of a packed binarization without packed kernel
+    kUnpackedOutput,
+
+    kCount,
+  };
+
+  // Caller-owned buffers reused across binarization calls: once every buffer
+  // has grown to the largest image seen, acquiring a temporary no longer
+  // allocates. Not thread-safe, use one workspace per thread.
+  class BinarizationWorkspace {
+   public:
+    // Continuous |size| x |type| matrix backed by the buffer of |slot|, valid
+    // until the next Acquire of the same slot. The buffer only grows when it
+    // is too small.
+    auto Acquire(WorkspaceSlot slot, const cv::Size& size, int type)
+      -> cv::Mat;
+
+    // Frees every buffer, counters are kept
+    void Release() noexcept;
+
+    // Bytes currently held by the buffers
+    [[nodiscard]] auto bytes_reserved() const noexcept -> size_t;
+
+    // Number of Acquire served without allocating
+    [[nodiscard]] auto reuse_hits() const noexcept -> size_t {
+      return reuse_hits_;
+    }
+
+    // |stats| collects the stages of the binarizations run with this
+    // workspace, and the buffers they grow, until it is detached with null
+    void set_stats(BinarizationStats* stats) noexcept {
+      stats_ = stats;
+    }
+
+    [[nodiscard]] auto stats() const noexcept -> BinarizationStats* {
+      return stats_;
+    }
+
+   private:
+    std::array<cv::Mat, static_cast<size_t>(WorkspaceSlot::kCount)>
+      buffers_{};
+    size_t reuse_hits_{0};
+    BinarizationStats* stats_{nullptr};
+  };
+
+  // Stats attached to |workspace|, null without workspace
+  inline auto GetStats(const BinarizationWorkspace* workspace) noexcept
+    -> BinarizationStats* {
+    return workspace == nullptr ? nullptr : workspace->stats();
+  }
+
+  // BinarizationWorkspace::Acquire when |workspace| is not null, a newly
+  // allocated matrix otherwise
+  inline auto AcquireBuffer(BinarizationWorkspace* workspace,
+                            const WorkspaceSlot slot,
+                            const cv::Size& size,
+                            const int type) -> cv::Mat {
+    if (workspace == nullptr) {
+      return cv::Mat{size, type};
+    }
+    return workspace->Acquire(slot, size, type);
+  }
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_BINARIZATION_WORKSPACE_HPP_
@@ -0,0 +1,284 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_CHUNGKWONG_CHAN_INTEGRAL_IMAGE_CALCULATOR_HPP_
+#define IMGPROC_COMMON_CHUNGKWONG_CHAN_INTEGRAL_IMAGE_CALCULATOR_HPP_
+
+#include <algorithm>   // std::fill_n
+#include <array>       // position
+#include <cstdint>
+#include <functional>   // std::invoke
+#include <utility>   // std::as_const
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/binarization_workspace.hpp"
+#include "imgproc/common/constant.hpp"
+#include "imgproc/common/local_sums.hpp"
+
+namespace longlp::imgproc {
+
+  // Chungkwong Chan, "Memory-efficient and fast implementation of local
+  // adaptive binarization methods".
+  //
+  // Drop-in replacement of IntegralImageCalculator: instead of full-size
+  // integral images, each worker keeps the sums of every column over the
+  // kernel rows, slides them down one row at a time, then sums them across the
+  // kernel columns with a single row prefix. The kernel window and the
+  // BORDER_REFLECT padding are the same as IntegralImageCalculator, and every
+  // sum is an exact integer, so both calculators give the same local sums.
+  //
+  // Peak extra memory, for a W x H input, a kw x kh kernel, T worker threads,
+  // dx = (kw - 1) / 2 and dy = (kh - 1) / 2:
+  // - IntegralImageCalculator: Order * 4 * (W + 1) * (H + 1) bytes of 32-bit
+  //   integral images (64-bit for kernels larger than 257 x 257), i.e.
+  //   ~560 MB for Order 2 on a 600 dpi A3 page (7016 x 9921) with a 75 x 75
+  //   kernel.
+  // - ChungkwongChanIntegralImageCalculator: T * Order * 8 * (3W + 2dx + 1)
+  //   bytes of running sums plus 4 * (W + 2dx) bytes of column mapping,
+  //   i.e. ~11 MB on the same page with T = 32.
+  class ChungkwongChanIntegralImageCalculator {
+   public:
+    // |processor| maps each pixel of the 8-bit |input| to the pixel at the
+    // same position of the 8-bit |output|, which must not share data with
+    // |input|. Temporaries are taken from |workspace| when it is not null.
+    template <size_t Order, class Processor>
+    requires LocalSumsProcessor<Processor, Order>
+    static void ConstructIntegralAndIterate(const cv::Mat& input,
+                                            cv::Mat& output,
+                                            const cv::Size& kernel_size,
+                                            BinarizationWorkspace* workspace,
+                                            Processor&& processor) noexcept {
+      // pre-conditions
+      if (kernel_size.empty()) {
+        CV_Error(cv::Error::Code::StsBadArg, "kernel size is empty");
+      }
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (input.type() != CV_8UC1 || input.dims != 2) {
+        CV_Error(cv::Error::Code::StsBadArg,
+                 "input must be 2D image, 8-bit, single channel");
+      }
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (output.type() != CV_8UC1 || output.dims != 2 ||
+          output.size() != input.size()) {
+        CV_Error(cv::Error::Code::StsBadArg,
+                 "output must be 2D image, 8-bit, single channel with the "
+                 "same size as input");
+      }
+
+      ConstructIntegralAndIterateRows<Order>(
+        input,
+        kernel_size,
+        workspace,
+        [&input, &output, &processor](
+          const int y,
+          const LocalSumsRows<Order>& local_sums_rows) {
+          const auto* input_pixels = input.ptr<GrayscalePixel>(y);
+          auto* output_pixels      = output.ptr<GrayscalePixel>(y);
+          for (auto x = 0; x < output.cols; ++x) {
+            LocalSums<Order> local_sums{};
+            for (size_t order = 0; order < Order; ++order) {
+              local_sums[order] = local_sums_rows[order][x];
+            }
+
+            const std::array<int, 2> position{y, x};
+            output_pixels[x] = std::invoke(processor,
+                                           input_pixels[x],
+                                           position.data(),
+                                           local_sums);
+          }
+        });
+    }
+
+    // Row variant of ConstructIntegralAndIterate: the local sums of a whole
+    // row are handed to |row_processor| at once, so that it can vectorize
+    // across the row.
+    template <size_t Order, class RowProcessor>
+    requires LocalSumsRowProcessor<RowProcessor, Order>
+    static void ConstructIntegralAndIterateRows(
+      const cv::Mat& input,
+      const cv::Size& kernel_size,
+      BinarizationWorkspace* workspace,
+      RowProcessor&& row_processor) noexcept {
+      // pre-conditions
+      if (kernel_size.empty()) {
+        CV_Error(cv::Error::Code::StsBadArg, "kernel size is empty");
+      }
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (input.type() != CV_8UC1 || input.dims != 2) {
+        CV_Error(cv::Error::Code::StsBadArg,
+                 "input must be 2D image, 8-bit, single channel");
+      }
+
+      const ScopedStageTimer timer{GetStats(workspace),
+                                   BinarizationStage::kTraversal,
+                                   input.total()};
+
+      const auto delta_x = (kernel_size.width - 1) / 2;
+      const auto delta_y = (kernel_size.height - 1) / 2;
+
+      const auto column_indices =
+        MakeReflectedIndices(input.cols, delta_x, workspace);
+      const auto padded_width = static_cast<size_t>(column_indices.cols);
+
+      // Every stripe of rows owns one row of running sums, so the stripes
+      // only share read-only data
+      const auto stripe_count   = GetStripeCount(input.rows);
+      auto stripe_buffers       = AcquireBuffer(
+        workspace,
+        WorkspaceSlot::kStripeBuffers,
+        cv::Size{static_cast<int>(RunningSums<Order>::GetSize(
+                   static_cast<size_t>(input.cols),
+                   padded_width)),
+                 stripe_count},
+        CV_64FC1);
+
+      cv::parallel_for_(
+        cv::Range{0, stripe_count},
+        [&input,
+         &row_processor,
+         &column_indices,
+         &padded_width,
+         &stripe_buffers,
+         &stripe_count,
+         &delta_x,
+         &delta_y](const cv::Range& stripes) {
+          const auto width    = static_cast<size_t>(input.cols);
+          const auto* indices = column_indices.ptr<int>(0);
+
+          for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+            const RunningSums<Order> running_sums{
+              stripe_buffers.ptr<double>(stripe),
+              width,
+              padded_width};
+
+            std::fill_n(running_sums.column_sums[0], Order * width, 0.0);
+
+            LocalSumsRows<Order> local_sums_rows{};
+            for (size_t order = 0; order < Order; ++order) {
+              running_sums.row_prefixes[order][0] = 0.0;
+              local_sums_rows[order]              = running_sums.sums[order];
+            }
+
+            const auto rows = GetStripeRows(stripe, stripe_count, input.rows);
+
+            // same window as IntegralImageCalculator: rows of the padded
+            // input in [y - delta_y + 1, y + delta_y]
+            for (auto y = rows.start - delta_y + 1; y <= rows.start + delta_y;
+                 ++y) {
+              AccumulateRow<Order>(input, y, 1.0, running_sums);
+            }
+
+            for (auto y = rows.start; y < rows.end; ++y) {
+              if (y != rows.start) {
+                AccumulateRow<Order>(input, y + delta_y, 1.0, running_sums);
+                AccumulateRow<Order>(input, y - delta_y, -1.0, running_sums);
+              }
+
+              // same window as IntegralImageCalculator: columns of the padded
+              // input in [x - delta_x + 1, x + delta_x]
+              const auto first = size_t{1};
+              const auto last  = 2 * static_cast<size_t>(delta_x) + 1;
+
+              for (size_t order = 0; order < Order; ++order) {
+                auto* row_prefix       = running_sums.row_prefixes[order];
+                const auto* column_sum = running_sums.column_sums[order];
+                for (size_t i = 0; i < padded_width; ++i) {
+                  row_prefix[i + 1] =
+                    row_prefix[i] +
+                    column_sum[static_cast<size_t>(indices[i])];
+                }
+
+                auto* sums = running_sums.sums[order];
+                for (size_t x = 0; x < width; ++x) {
+                  sums[x] = row_prefix[x + last] - row_prefix[x + first];
+                }
+              }
+
+              std::invoke(row_processor, y, std::as_const(local_sums_rows));
+            }
+          }
+        },
+        static_cast<double>(stripe_count));
+    }
+
+   private:
+    // Views on the running sums of one stripe, laid out in a single row of
+    // doubles:
+    // - column_sums[order]: sum of I^(order + 1) of every column over the
+    //   kernel rows, width values
+    // - row_prefixes[order]: prefix sums of column_sums across the padded
+    //   columns, padded_width + 1 values
+    // - sums[order]: local sums of the current row, width values
+    template <size_t Order>
+    struct RunningSums {
+      std::array<double*, Order> column_sums{};
+      std::array<double*, Order> row_prefixes{};
+      std::array<double*, Order> sums{};
+
+      RunningSums(double* data,
+                  const size_t width,
+                  const size_t padded_width) noexcept {
+        for (size_t order = 0; order < Order; ++order) {
+          column_sums[order] = data + order * width;
+        }
+        data += Order * width;
+        for (size_t order = 0; order < Order; ++order) {
+          row_prefixes[order] = data + order * (padded_width + 1);
+        }
+        data += Order * (padded_width + 1);
+        for (size_t order = 0; order < Order; ++order) {
+          sums[order] = data + order * width;
+        }
+      }
+
+      static constexpr auto GetSize(const size_t width,
+                                    const size_t padded_width) noexcept
+        -> size_t {
+        return Order * (2 * width + padded_width + 1);
+      }
+    };
+
+    // index of the input column for each column of the padded input, the
+    // padded column c is stored at c + padding_size
+    static auto MakeReflectedIndices(const int size,
+                                     const int padding_size,
+                                     BinarizationWorkspace* workspace)
+      -> cv::Mat {
+      auto indices = AcquireBuffer(workspace,
+                                   WorkspaceSlot::kColumnIndices,
+                                   cv::Size{size + 2 * padding_size, 1},
+                                   CV_32SC1);
+      auto* index = indices.ptr<int>(0);
+      for (auto i = 0; i < indices.cols; ++i) {
+        index[i] = cv::borderInterpolate(i - padding_size,
+                                         size,
+                                         cv::BorderTypes::BORDER_REFLECT);
+      }
+      return indices;
+    }
+
+    // column_sums[order] += sign * I^(order + 1) for the padded row |y|
+    template <size_t Order>
+    static void AccumulateRow(const cv::Mat& input,
+                              const int y,
+                              const double sign,
+                              const RunningSums<Order>& running_sums) noexcept {
+      const auto* pixels = input.ptr<uint8_t>(
+        cv::borderInterpolate(y, input.rows, cv::BorderTypes::BORDER_REFLECT));
+
+      for (size_t x = 0; x < static_cast<size_t>(input.cols); ++x) {
+        const double value = pixels[x];
+
+        auto power = sign;
+        for (size_t order = 0; order < Order; ++order) {
+          power *= value;
+          running_sums.column_sums[order][x] += power;
+        }
+      }
+    }
+  };
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_CHUNGKWONG_CHAN_INTEGRAL_IMAGE_CALCULATOR_HPP_
@@ -6,6 +6,10 @@
 #define IMGPROC_CONSTANT_HPP_
 
 #include <cstdint>
+#include <functional>    // std::invoke
+#include <type_traits>   // std::bool_constant
+#include <utility>       // std::forward
+
 namespace longlp::imgproc {
   using GrayscalePixel = uint8_t;
 
@@ -26,6 +30,24 @@ namespace longlp::imgproc {
     }
   };
 
+  // BinaryColorPair fixed at compile time: kernels instantiated per polarity
+  // pick a color with a mask instead of a data-dependent select
+  template <bool UseBackgroundWhiteColor>
+  inline constexpr auto kBinaryColors = UseBackgroundWhiteColor
+                                          ? BinaryColorPair::Get()
+                                          : BinaryColorPair::GetInverse();
+
+  // Calls |function| with std::bool_constant<use_background_white_color>,
+  // so that the polarity is dispatched once per call rather than per pixel
+  template <class Function>
+  decltype(auto) DispatchPolarity(const bool use_background_white_color,
+                                  Function&& function) {
+    if (use_background_white_color) {
+      return std::invoke(std::forward<Function>(function), std::true_type{});
+    }
+    return std::invoke(std::forward<Function>(function), std::false_type{});
+  }
+
 }   // namespace longlp::imgproc
 
 #endif   // IMGPROC_CONSTANT_HPP_
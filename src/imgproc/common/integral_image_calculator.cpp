@@ -4,47 +4,239 @@
 
 #include "imgproc/common/integral_image_calculator.hpp"
 
+#include <algorithm>   // std::fill_n, std::max
+#include <limits>
+#include <type_traits>   // std::conditional_t
+
+#include <opencv2/core/hal/intrin.hpp>
+
+#include "imgproc/common/constant.hpp"
+
 namespace {
+  using longlp::imgproc::BinarizationStage;
+  using longlp::imgproc::BinarizationWorkspace;
+  using longlp::imgproc::GetStripeCount;
+  using longlp::imgproc::GetStripeRows;
   using longlp::imgproc::IntegralImageCalculator;
+  using longlp::imgproc::kGrayscaleMax;
+  using longlp::imgproc::ScopedStageTimer;
+  using longlp::imgproc::WorkspaceSlot;
 
   using ErrorCode = cv::Error::Code;
+
+  // row[x] += carry[x] for the |size| sums of a row, wrapping around
+  template <class SumType>
+  void AddCarryRow(const SumType* carry,
+                   SumType* row,
+                   const size_t size) noexcept {
+    size_t x = 0;
+#if CV_SIMD
+    using Vector = std::conditional_t<std::is_same_v<SumType, uint32_t>,
+                                      cv::v_uint32,
+                                      cv::v_uint64>;
+    const auto lanes = static_cast<size_t>(cv::VTraits<Vector>::vlanes());
+    for (; x + lanes <= size; x += lanes) {
+      cv::v_store(row + x,
+                  cv::v_add(cv::vx_load(row + x), cv::vx_load(carry + x)));
+    }
+#endif
+    for (; x < size; ++x) {
+      row[x] += carry[x];
+    }
+  }
+
+  // First pass over the rows |rows| of |input|: the integral image rows
+  // y + 1 of I, and of I^2 when SquareSumType is not void, as if the rows
+  // above |rows| were 0. Each pixel is read once for both images.
+  template <class SumType, class SquareSumType>
+  void ScanStripeRows(const cv::Mat& input,
+                      const cv::Range& rows,
+                      cv::Mat& integral_image,
+                      cv::Mat* square_integral_image) noexcept {
+    constexpr auto kWithSquares = !std::is_void_v<SquareSumType>;
+    const auto size = static_cast<size_t>(integral_image.cols);
+
+    for (auto y = rows.start; y < rows.end; ++y) {
+      const auto* pixels = input.ptr<uint8_t>(y);
+      auto* sums         = integral_image.ptr<SumType>(y + 1);
+
+      // unsigned arithmetic, wraps around on overflow
+      SumType row_sum{0};
+      sums[0] = SumType{0};
+      if constexpr (kWithSquares) {
+        auto* square_sums = square_integral_image->ptr<SquareSumType>(y + 1);
+
+        SquareSumType square_row_sum{0};
+        square_sums[0] = SquareSumType{0};
+        for (auto x = 0; x < input.cols; ++x) {
+          const SquareSumType value = pixels[x];
+          row_sum += static_cast<SumType>(value);
+          square_row_sum += value * value;
+          sums[x + 1]        = row_sum;
+          square_sums[x + 1] = square_row_sum;
+        }
+        if (y > rows.start) {
+          AddCarryRow(square_integral_image->ptr<SquareSumType>(y),
+                      square_sums,
+                      size);
+        }
+      }
+      else {
+        for (auto x = 0; x < input.cols; ++x) {
+          row_sum += SumType{pixels[x]};
+          sums[x + 1] = row_sum;
+        }
+      }
+      if (y > rows.start) {
+        AddCarryRow(integral_image.ptr<SumType>(y), sums, size);
+      }
+    }
+  }
+
+  // Blocked two-pass prefix sum over stripes of rows: each stripe scans its
+  // rows on its own, the last rows of the stripes are then carried down one
+  // after the other, and every stripe finally adds the last row of the
+  // stripe above to its other rows.
+  template <class SumType, class SquareSumType>
+  void MakeIntegralImagesAs(const cv::Mat& input,
+                            cv::Mat& integral_image,
+                            cv::Mat* square_integral_image) {
+    constexpr auto kWithSquares = !std::is_void_v<SquareSumType>;
+    const auto size = static_cast<size_t>(integral_image.cols);
+
+    std::fill_n(integral_image.ptr<SumType>(0), size, SumType{0});
+    if constexpr (kWithSquares) {
+      std::fill_n(square_integral_image->ptr<SquareSumType>(0),
+                  size,
+                  SquareSumType{0});
+    }
+
+    const auto stripe_count = GetStripeCount(input.rows);
+    cv::parallel_for_(
+      cv::Range{0, stripe_count},
+      [&input, &integral_image, &square_integral_image, &stripe_count](
+        const cv::Range& stripes) {
+        for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+          ScanStripeRows<SumType, SquareSumType>(
+            input,
+            GetStripeRows(stripe, stripe_count, input.rows),
+            integral_image,
+            square_integral_image);
+        }
+#if CV_SIMD
+        cv::vx_cleanup();
+#endif
+      },
+      static_cast<double>(stripe_count));
+
+    // integral image row r holds the sums of the input rows [0, r), the
+    // first row of the stripe is the last row of the stripe above
+    for (auto stripe = 1; stripe < stripe_count; ++stripe) {
+      const auto rows = GetStripeRows(stripe, stripe_count, input.rows);
+      AddCarryRow(integral_image.ptr<SumType>(rows.start),
+                  integral_image.ptr<SumType>(rows.end),
+                  size);
+      if constexpr (kWithSquares) {
+        AddCarryRow(square_integral_image->ptr<SquareSumType>(rows.start),
+                    square_integral_image->ptr<SquareSumType>(rows.end),
+                    size);
+      }
+    }
+
+    cv::parallel_for_(
+      cv::Range{1, std::max(stripe_count, 1)},
+      [&input, &integral_image, &square_integral_image, &stripe_count, &size](
+        const cv::Range& stripes) {
+        for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+          const auto rows = GetStripeRows(stripe, stripe_count, input.rows);
+          for (auto y = rows.start + 1; y < rows.end; ++y) {
+            AddCarryRow(integral_image.ptr<SumType>(rows.start),
+                        integral_image.ptr<SumType>(y),
+                        size);
+            if constexpr (kWithSquares) {
+              AddCarryRow(
+                square_integral_image->ptr<SquareSumType>(rows.start),
+                square_integral_image->ptr<SquareSumType>(y),
+                size);
+            }
+          }
+        }
+#if CV_SIMD
+        cv::vx_cleanup();
+#endif
+      },
+      static_cast<double>(stripe_count));
+  }
 }   // namespace
 
 // static
-// The border type is referenced in
-// https://www.mathworks.com/help/images/ref/stdfilt.html
-auto IntegralImageCalculator::MakePaddedInputForIntegral(
+auto IntegralImageCalculator::GetStorageType(const int power,
+                                             const cv::Size& kernel_size)
+  -> int {
+  // The kernel window holds at most kernel_size.area() pixels
+  const auto max_pixel_power = power == 1
+                                 ? double{kGrayscaleMax}
+                                 : double{kGrayscaleMax} * kGrayscaleMax;
+  const auto fits_in_uint32 =
+    max_pixel_power * kernel_size.area() <=
+    double{std::numeric_limits<uint32_t>::max()};
+  return fits_in_uint32 ? kUInt32StorageType : kUInt64StorageType;
+}
+
+// static
+void IntegralImageCalculator::MakeIntegralImages(
   const cv::Mat& input,
-  const int top_padding_size,
-  const int bottom_padding_size,
-  const int left_padding_size,
-  const int right_padding_size) noexcept -> cv::Mat {
+  const cv::Size& kernel_size,
+  BinarizationWorkspace* workspace,
+  cv::Mat& integral_image,
+  cv::Mat* square_integral_image) noexcept {
   // pre-conditions
-  if (top_padding_size < 0 || bottom_padding_size < 0 ||
-      left_padding_size < 0 || right_padding_size < 0) {
-    CV_Error(ErrorCode::StsBadArg, "padding size must be positive integer");
-  }
-
-  // Create padding with kernel
-  cv::Mat padded_input = input.clone();
-  cv::copyMakeBorder(padded_input,
-                     padded_input,
-                     top_padding_size,
-                     bottom_padding_size,
-                     left_padding_size,
-                     right_padding_size,
-                     cv::BorderTypes::BORDER_REFLECT,   // symmetric padding
-                     cv::Scalar()   // no-op when using BORDER_REFLECT
-  );
-
-  // post-conditions
-  if (padded_input.type() != input.type() || padded_input.dims != input.dims ||
-      padded_input.size() !=
-        cv::Size(input.cols + left_padding_size + right_padding_size,
-                 input.rows + top_padding_size + bottom_padding_size)) {
-    CV_Error(ErrorCode::StsInternal,
-             "padded image neither have same type and dims as input image nor "
-             "size is not Size(src.cols+left+right, src.rows+top+bottom)");
-  }
-  return padded_input;
+  if (input.type() != CV_8UC1) {
+    CV_Error(ErrorCode::StsBadArg, "input is not 8-bit image");
+  }
+
+  const ScopedStageTimer timer{GetStats(workspace),
+                               BinarizationStage::kIntegralImage,
+                               input.total()};
+
+  const cv::Size size{input.cols + 1, input.rows + 1};
+  integral_image = AcquireBuffer(workspace,
+                                 WorkspaceSlot::kIntegralImage,
+                                 size,
+                                 GetStorageType(1, kernel_size));
+  const auto is_uint32 = integral_image.type() == kUInt32StorageType;
+
+  if (square_integral_image == nullptr) {
+    if (is_uint32) {
+      MakeIntegralImagesAs<uint32_t, void>(input, integral_image, nullptr);
+    }
+    else {
+      MakeIntegralImagesAs<uint64_t, void>(input, integral_image, nullptr);
+    }
+    return;
+  }
+
+  *square_integral_image = AcquireBuffer(workspace,
+                                         WorkspaceSlot::kSquareIntegralImage,
+                                         size,
+                                         GetStorageType(2, kernel_size));
+  const auto is_square_uint32 =
+    square_integral_image->type() == kUInt32StorageType;
+
+  // the squares need at least as many bits as the sums
+  if (is_square_uint32) {
+    MakeIntegralImagesAs<uint32_t, uint32_t>(input,
+                                             integral_image,
+                                             square_integral_image);
+  }
+  else if (is_uint32) {
+    MakeIntegralImagesAs<uint32_t, uint64_t>(input,
+                                             integral_image,
+                                             square_integral_image);
+  }
+  else {
+    MakeIntegralImagesAs<uint64_t, uint64_t>(input,
+                                             integral_image,
+                                             square_integral_image);
+  }
 }
@@ -5,130 +5,329 @@
 #ifndef IMGPROC_COMMON_INTEGRAL_IMAGE_CALCULATOR_HPP_
 #define IMGPROC_COMMON_INTEGRAL_IMAGE_CALCULATOR_HPP_
 
-#include <array>   // IntegralImages
+#include <algorithm>   // std::clamp, std::fill_n
+#include <array>       // IntegralImages
 #include <concepts>
 #include <cstdint>
-#include <type_traits>
+#include <functional>   // std::invoke
 #include <utility>   // std::as_const
 
 #include <opencv2/imgproc.hpp>
 
+#include "imgproc/common/binarization_workspace.hpp"
+#include "imgproc/common/constant.hpp"
+#include "imgproc/common/local_sums.hpp"
+
 namespace longlp::imgproc {
   class IntegralImageCalculator {
    public:
-    struct KernelVertices {
-      int top;
-      int bottom;
-      int left;
-      int right;
-    };
-
     template <size_t Order>
     using IntegralImages = std::array<cv::Mat, Order>;
 
     // https://en.wikipedia.org/wiki/Summed-area_table
-    template <class PixelType, size_t Order, class Processor>
-    requires requires {
-      requires std::is_same_v<PixelType, uint8_t> ||
-        std::is_same_v<PixelType, double> || std::is_same_v<PixelType, float>;
-
-      requires requires(Processor && processor,
-                        PixelType & pixel,
-                        const int* position,
-                        const IntegralImages<Order>& integral_images,
-                        const KernelVertices& kernel_vertices) {
-        {
-          processor(pixel, position, integral_images, kernel_vertices)
-          } -> std::same_as<void>;
-      };
-    }
-    static void ConstructIntegralAndIterate(cv::Mat& input_output,
+    // |processor| maps each pixel of the 8-bit |input| to the pixel at the
+    // same position of the 8-bit |output|, which must not share data with
+    // |input|. Temporaries are taken from |workspace| when it is not null.
+    template <size_t Order, class Processor>
+    requires LocalSumsProcessor<Processor, Order>
+    static void ConstructIntegralAndIterate(const cv::Mat& input,
+                                            cv::Mat& output,
                                             const cv::Size& kernel_size,
+                                            BinarizationWorkspace* workspace,
                                             Processor&& processor) noexcept {
       // pre-conditions
       if (kernel_size.empty()) {
         CV_Error(cv::Error::Code::StsBadArg, "kernel size is empty");
       }
-      if (!(input_output.dims == 2 &&
-            (input_output.type() == CV_8U || input_output.type() == CV_32F ||
-             input_output.type() == CV_64F))) {
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (input.type() != CV_8UC1 || input.dims != 2) {
         CV_Error(cv::Error::Code::StsBadArg,
-                 "input_output must be 2D image, 8-bit or floating point "
-                 "(32-bit, 64-bit)");
+                 "input must be 2D image, 8-bit, single channel");
+      }
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (output.type() != CV_8UC1 || output.dims != 2 ||
+          output.size() != input.size()) {
+        CV_Error(cv::Error::Code::StsBadArg,
+                 "output must be 2D image, 8-bit, single channel with the "
+                 "same size as input");
+      }
+
+      ConstructIntegralAndIterateRows<Order>(
+        input,
+        kernel_size,
+        workspace,
+        [&input, &output, &processor](
+          const int y,
+          const LocalSumsRows<Order>& local_sums_rows) {
+          const auto* input_pixels = input.ptr<GrayscalePixel>(y);
+          auto* output_pixels      = output.ptr<GrayscalePixel>(y);
+          for (auto x = 0; x < output.cols; ++x) {
+            LocalSums<Order> local_sums{};
+            for (size_t order = 0; order < Order; ++order) {
+              local_sums[order] = local_sums_rows[order][x];
+            }
+
+            const std::array<int, 2> position{y, x};
+            output_pixels[x] = std::invoke(processor,
+                                           input_pixels[x],
+                                           position.data(),
+                                           local_sums);
+          }
+        });
+    }
+
+    // Row variant of ConstructIntegralAndIterate, which it is built on: the
+    // local sums of a whole row are handed to |row_processor| at once, so
+    // that it can vectorize across the row. Rows are split into stripes of
+    // consecutive rows processed in parallel.
+    template <size_t Order, class RowProcessor>
+    requires LocalSumsRowProcessor<RowProcessor, Order>
+    static void ConstructIntegralAndIterateRows(
+      const cv::Mat& input,
+      const cv::Size& kernel_size,
+      BinarizationWorkspace* workspace,
+      RowProcessor&& row_processor) noexcept {
+      // pre-conditions
+      if (kernel_size.empty()) {
+        CV_Error(cv::Error::Code::StsBadArg, "kernel size is empty");
+      }
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (input.type() != CV_8UC1 || input.dims != 2) {
+        CV_Error(cv::Error::Code::StsBadArg,
+                 "input must be 2D image, 8-bit, single channel");
       }
 
       const auto delta_x = (kernel_size.width - 1) / 2;
       const auto delta_y = (kernel_size.height - 1) / 2;
 
-      const cv::Mat& padded_input =
-        MakePaddedInputForIntegral(input_output,
-                                   delta_y /* top */,
-                                   delta_y /* bottom */,
-                                   delta_x /* left */,
-                                   delta_x /* right */);
-
-      const auto integral_images = MakeIntegralImage<Order>(padded_input);
-
-      input_output.forEach<PixelType>(
-        [&delta_x, &delta_y, &integral_images, &processor](
-          PixelType& pixel,
-          const int* position) {
-          // map index from input to integral matrices
-          const auto iy = position[0] + delta_y + 1;
-          const auto ix = position[1] + delta_x + 1;
-
-          const auto top    = iy - delta_y;
-          const auto bottom = iy + delta_y;
-          const auto left   = ix - delta_x;
-          const auto right  = ix + delta_x;
-
-          std::invoke(processor,
-                      pixel,
-                      position,
-                      std::as_const(integral_images),
-                      KernelVertices{top, bottom, left, right});
-        });
+      const auto integral_images =
+        MakeIntegralImage<Order>(input, kernel_size, workspace);
+
+      const ScopedStageTimer timer{GetStats(workspace),
+                                   BinarizationStage::kTraversal,
+                                   input.total()};
+
+      // one row of Order buffers of local sums per stripe, and the top and
+      // bottom integral rows summed over the reflected runs of a border row
+      const auto stripe_count   = GetStripeCount(input.rows);
+      auto stripe_buffers       = AcquireBuffer(
+        workspace,
+        WorkspaceSlot::kStripeBuffers,
+        cv::Size{static_cast<int>(Order) * input.cols, stripe_count},
+        CV_64FC1);
+      auto stripe_border_rows = AcquireBuffer(
+        workspace,
+        WorkspaceSlot::kBorderRows,
+        cv::Size{2 * (input.cols + 1), stripe_count},
+        kUInt64StorageType);
+
+      cv::parallel_for_(
+        cv::Range{0, stripe_count},
+        [&input,
+         &integral_images,
+         &row_processor,
+         &stripe_buffers,
+         &stripe_border_rows,
+         &stripe_count,
+         &delta_x,
+         &delta_y](const cv::Range& stripes) {
+          const auto width = static_cast<size_t>(input.cols);
+
+          for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+            auto* buffers     = stripe_buffers.ptr<double>(stripe);
+            auto* border_rows = stripe_border_rows.ptr<uint64_t>(stripe);
+
+            LocalSumsRows<Order> local_sums_rows{};
+            for (size_t order = 0; order < Order; ++order) {
+              local_sums_rows[order] = buffers + order * width;
+            }
+
+            const auto rows = GetStripeRows(stripe, stripe_count, input.rows);
+            for (auto y = rows.start; y < rows.end; ++y) {
+              // rows [y - delta_y + 1, y + delta_y] and columns
+              // [x - delta_x + 1, x + delta_x] of the padded input
+              const cv::Range window_rows{y - delta_y + 1, y + delta_y + 1};
+
+              for (size_t order = 0; order < Order; ++order) {
+                SumReflectedWindowRow(integral_images[order],
+                                      window_rows,
+                                      delta_x,
+                                      border_rows,
+                                      buffers + order * width);
+              }
+
+              std::invoke(row_processor, y, std::as_const(local_sums_rows));
+            }
+          }
+        },
+        static_cast<double>(stripe_count));
     }
 
    private:
-    static auto MakePaddedInputForIntegral(const cv::Mat& input,
-                                           int top_padding_size,
-                                           int bottom_padding_size,
-                                           int left_padding_size,
-                                           int right_padding_size) noexcept
-      -> cv::Mat;
+    // OpenCV 4 has no unsigned nor 64-bit integer depth, the integral images
+    // keep their sums in a storage type with the same element size
+    static constexpr auto kUInt32StorageType = CV_32SC1;
+    static constexpr auto kUInt64StorageType = CV_32SC2;
+
+    // Storage type of the integral image of I^power, in exact unsigned
+    // integers: 32-bit when the sum of one kernel window always fits,
+    // 64-bit otherwise
+    static auto GetStorageType(int power, const cv::Size& kernel_size) -> int;
+
+    // Integral images of I and, when |square_integral_image| is not null,
+    // of I^2, built together in one pass over |input| split into stripes of
+    // rows in parallel
+    static void MakeIntegralImages(const cv::Mat& input,
+                                   const cv::Size& kernel_size,
+                                   BinarizationWorkspace* workspace,
+                                   cv::Mat& integral_image,
+                                   cv::Mat* square_integral_image) noexcept;
 
     template <size_t Order>
-    static auto MakeIntegralImage(const cv::Mat& input) noexcept
-      -> IntegralImages<Order>;
-  };
+    requires(Order == 1 || Order == 2)
+    static auto MakeIntegralImage(const cv::Mat& input,
+                                  const cv::Size& kernel_size,
+                                  BinarizationWorkspace* workspace) noexcept
+      -> IntegralImages<Order> {
+      IntegralImages<Order> integral_images{};
+      MakeIntegralImages(input,
+                         kernel_size,
+                         workspace,
+                         integral_images[0],
+                         Order == 2 ? &integral_images[Order - 1] : nullptr);
+      return integral_images;
+    }
+
+    // Calls |visit| with each run of |range|, a range of the BORDER_REFLECT
+    // padded axis of |size| pixels, that maps to a range of the axis itself:
+    // forward runs keep the padded order, mirrored runs reverse it, which
+    // does not matter to a sum. Ranges wider than the axis reflect again.
+    template <class Visitor>
+    static void ForEachReflectedRun(const cv::Range& range,
+                                    const int size,
+                                    Visitor&& visit) noexcept {
+      const auto period = 2 * size;
+      for (auto i = range.start; i < range.end;) {
+        const auto phase = (i % period + period) % period;
+        if (phase < size) {
+          const auto length = std::min(range.end - i, size - phase);
+          visit(cv::Range{phase, phase + length});
+          i += length;
+        }
+        else {
+          // padded index i reads period - 1 - phase, then decreases
+          const auto length = std::min(range.end - i, period - phase);
+          const auto last   = period - 1 - phase;
+          visit(cv::Range{last - length + 1, last + 1});
+          i += length;
+        }
+      }
+    }
+
+    // Local sums of every column of a row, from the integral rows |top| and
+    // |bottom| of its window rows: the window columns of the inner columns
+    // are inside the input, those of the border columns are split into
+    // reflected runs. Sums are unsigned, an overflow of the integral image
+    // wraps around and cancels out since the sum of the window itself fits
+    // in SumType.
+    template <class SumType>
+    static void SumReflectedColumnsAs(const SumType* top,
+                                      const SumType* bottom,
+                                      const int width,
+                                      const int delta_x,
+                                      double* sums) noexcept {
+      const auto inner_begin = std::clamp(delta_x - 1, 0, width);
+      const auto inner_end   = std::max(inner_begin, width - delta_x);
+
+      const auto sum_border_column = [&top, &bottom, &width, &delta_x, &sums](
+                                       const int x) {
+        SumType sum{0};
+        ForEachReflectedRun(cv::Range{x - delta_x + 1, x + delta_x + 1},
+                            width,
+                            [&top, &bottom, &sum](const cv::Range& run) {
+                              sum += (bottom[run.end] - bottom[run.start]) -
+                                     (top[run.end] - top[run.start]);
+                            });
+        sums[x] = static_cast<double>(sum);
+      };
+
+      for (auto x = 0; x < inner_begin; ++x) {
+        sum_border_column(x);
+      }
+      for (auto x = inner_begin; x < inner_end; ++x) {
+        const auto right         = x + delta_x + 1;
+        const auto left          = x - delta_x + 1;
+        const SumType bottom_sum = bottom[right] - bottom[left];
+        const SumType top_sum    = top[right] - top[left];
+        sums[x]                  = static_cast<double>(bottom_sum - top_sum);
+      }
+      for (auto x = inner_end; x < width; ++x) {
+        sum_border_column(x);
+      }
+    }
+
+    // SumReflectedColumnsAs of the row whose window rows are |window_rows|.
+    // Inside the input, these are two rows of |integral_image|; on the
+    // border, the rows of each reflected run are summed into |border_rows|,
+    // 2 * integral_image.cols elements of SumType.
+    template <class SumType>
+    static void SumReflectedWindowRowAs(const cv::Mat& integral_image,
+                                        const cv::Range& window_rows,
+                                        const int delta_x,
+                                        SumType* border_rows,
+                                        double* sums) noexcept {
+      const auto height = integral_image.rows - 1;
+      const auto width  = integral_image.cols - 1;
+
+      if (window_rows.start >= 0 && window_rows.end <= height) {
+        SumReflectedColumnsAs(integral_image.ptr<SumType>(window_rows.start),
+                              integral_image.ptr<SumType>(window_rows.end),
+                              width,
+                              delta_x,
+                              sums);
+        return;
+      }
+
+      auto* top    = border_rows;
+      auto* bottom = border_rows + integral_image.cols;
+      std::fill_n(border_rows, 2 * integral_image.cols, SumType{0});
+
+      ForEachReflectedRun(
+        window_rows,
+        height,
+        [&integral_image, &top, &bottom](const cv::Range& run) {
+          const auto* run_top    = integral_image.ptr<SumType>(run.start);
+          const auto* run_bottom = integral_image.ptr<SumType>(run.end);
+          for (auto x = 0; x < integral_image.cols; ++x) {
+            top[x] += run_top[x];
+            bottom[x] += run_bottom[x];
+          }
+        });
 
-  // static
-  template <>
-  inline auto IntegralImageCalculator::MakeIntegralImage<1>(
-    const cv::Mat& padded_input) noexcept -> IntegralImages<1> {
-    // Calculate integral image 1st
-    cv::Mat integral_1st_order;
-    cv::integral(padded_input,
-                 integral_1st_order /* sum */,
-                 CV_64F /* force to store double in sum */);
-    return {integral_1st_order};
-  }
-
-  // static
-  template <>
-  inline auto IntegralImageCalculator::MakeIntegralImage<2>(
-    const cv::Mat& padded_input) noexcept -> IntegralImages<2> {
-    // Calculate integral image 1st and 2nd Order
-    cv::Mat integral_1st_order;
-    cv::Mat integral_2nd_order;
-    cv::integral(padded_input,
-                 integral_1st_order /* sum */,
-                 integral_2nd_order /* square sum */,
-                 CV_64F /* force to store double in sum */,
-                 CV_64F /* force to store double in square sum */);
-    return {integral_1st_order, integral_2nd_order};
-  }
+      SumReflectedColumnsAs(top, bottom, width, delta_x, sums);
+    }
+
+    static void SumReflectedWindowRow(const cv::Mat& integral_image,
+                                      const cv::Range& window_rows,
+                                      const int delta_x,
+                                      uint64_t* border_rows,
+                                      double* sums) noexcept {
+      if (integral_image.type() == kUInt32StorageType) {
+        SumReflectedWindowRowAs(integral_image,
+                                window_rows,
+                                delta_x,
+                                reinterpret_cast<uint32_t*>(border_rows),
+                                sums);
+      }
+      else {
+        SumReflectedWindowRowAs(integral_image,
+                                window_rows,
+                                delta_x,
+                                border_rows,
+                                sums);
+      }
+    }
+  };
 }   // namespace longlp::imgproc
 
 #endif   // IMGPROC_COMMON_INTEGRAL_IMAGE_CALCULATOR_HPP_
@@ -0,0 +1,226 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/common/joint_histogram.hpp"
+
+#include <algorithm>   // std::fill_n
+#include <cstddef>
+#include <cstdint>
+
+#include "imgproc/common/constant.hpp"
+#include "imgproc/common/local_sums.hpp"
+
+namespace {
+  using longlp::imgproc::BinarizationWorkspace;
+  using longlp::imgproc::GetStripeCount;
+  using longlp::imgproc::GetStripeRows;
+  using longlp::imgproc::GrayscalePixel;
+  using longlp::imgproc::kJointHistogramSize;
+  using longlp::imgproc::WorkspaceSlot;
+
+  using ErrorCode = cv::Error::Code;
+
+  constexpr auto kBinCount =
+    static_cast<size_t>(kJointHistogramSize) * kJointHistogramSize;
+
+  // bins[i * kJointHistogramSize + j] += 1 for each pair (first[x], second[x])
+  void CountRow(const GrayscalePixel* first,
+                const GrayscalePixel* second,
+                const size_t width,
+                uint32_t* bins) noexcept {
+    for (size_t x = 0; x < width; ++x) {
+      ++bins[static_cast<size_t>(first[x]) * kJointHistogramSize + second[x]];
+    }
+  }
+
+  // Runs |count_rows|(stripe, rows, bins) over stripes of |rows| rows in
+  // parallel, each one with its own zeroed integer bins, then sums them up
+  // into |histogram|
+  template <class CountRows>
+  void BuildJointHistogram(const int rows,
+                           cv::Mat& histogram,
+                           BinarizationWorkspace* workspace,
+                           const CountRows& count_rows) {
+    const auto stripe_count = GetStripeCount(rows);
+    auto stripe_histograms  = AcquireBuffer(
+      workspace,
+      WorkspaceSlot::kStripeHistograms,
+      cv::Size{static_cast<int>(kBinCount), stripe_count},
+      CV_32SC1);
+
+    cv::parallel_for_(
+      cv::Range{0, stripe_count},
+      [&rows, &stripe_histograms, &stripe_count, &count_rows](
+        const cv::Range& stripes) {
+        for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+          auto* bins = stripe_histograms.ptr<uint32_t>(stripe);
+          std::fill_n(bins, kBinCount, uint32_t{0});
+          count_rows(stripe,
+                     GetStripeRows(stripe, stripe_count, rows),
+                     bins);
+        }
+      },
+      static_cast<double>(stripe_count));
+
+    histogram.create(kJointHistogramSize, kJointHistogramSize, CV_64FC1);
+    for (auto i = 0; i < kJointHistogramSize; ++i) {
+      auto* counts = histogram.ptr<double>(i);
+      std::fill_n(counts, kJointHistogramSize, 0.0);
+
+      const auto offset = static_cast<size_t>(i) * kJointHistogramSize;
+      for (auto stripe = 0; stripe < stripe_count; ++stripe) {
+        const auto* bins = stripe_histograms.ptr<uint32_t>(stripe) + offset;
+        for (size_t j = 0; j < kJointHistogramSize; ++j) {
+          counts[j] += static_cast<double>(bins[j]);
+        }
+      }
+    }
+  }
+
+  // column_sums += sign * I for the row |y| of the input reflected at its
+  // edges
+  void AccumulateColumnSums(const cv::Mat& input,
+                            const int y,
+                            const double sign,
+                            double* column_sums) noexcept {
+    const auto* pixels = input.ptr<GrayscalePixel>(
+      cv::borderInterpolate(y, input.rows, cv::BorderTypes::BORDER_REFLECT));
+    for (size_t x = 0; x < static_cast<size_t>(input.cols); ++x) {
+      column_sums[x] += sign * static_cast<double>(pixels[x]);
+    }
+  }
+}   // namespace
+
+void longlp::imgproc::MakeJointHistogram(const cv::Mat& first,
+                                         const cv::Mat& second,
+                                         cv::Mat& histogram,
+                                         BinarizationWorkspace* workspace) {
+  // pre-conditions
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if (first.type() != CV_8UC1 || second.type() != CV_8UC1 ||
+      first.dims != 2 || first.size() != second.size()) {
+    CV_Error(ErrorCode::StsBadArg,
+             "planes must be 2D images, 8-bit, single channel of the same "
+             "size");
+  }
+
+  BuildJointHistogram(
+    first.rows,
+    histogram,
+    workspace,
+    [&first, &second]([[maybe_unused]] const int stripe,
+                      const cv::Range& rows,
+                      uint32_t* bins) {
+      for (auto y = rows.start; y < rows.end; ++y) {
+        CountRow(first.ptr<GrayscalePixel>(y),
+                 second.ptr<GrayscalePixel>(y),
+                 static_cast<size_t>(first.cols),
+                 bins);
+      }
+    });
+}
+
+void longlp::imgproc::MakeJointHistogramWithMean(
+  const cv::Mat& input,
+  const cv::Size& kernel_size,
+  cv::Mat& histogram,
+  BinarizationWorkspace* workspace) {
+  // pre-conditions
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if (input.type() != CV_8UC1 || input.dims != 2) {
+    CV_Error(ErrorCode::StsBadArg,
+             "input must be 2D image, 8-bit, single channel");
+  }
+  if (kernel_size.empty()) {
+    CV_Error(ErrorCode::StsBadArg, "kernel size is empty");
+  }
+
+  // same window as cv::blur: anchor at the kernel center
+  const auto anchor_x     = kernel_size.width / 2;
+  const auto anchor_y     = kernel_size.height / 2;
+  const auto width        = static_cast<size_t>(input.cols);
+  const auto padded_width = width + static_cast<size_t>(kernel_size.width) - 1;
+  const auto inverse_area = 1.0 / static_cast<double>(kernel_size.area());
+
+  // index of the input column for each column of the padded input
+  auto column_indices =
+    AcquireBuffer(workspace,
+                  WorkspaceSlot::kColumnIndices,
+                  cv::Size{static_cast<int>(padded_width), 1},
+                  CV_32SC1);
+  auto* index = column_indices.ptr<int>(0);
+  for (auto i = 0; i < column_indices.cols; ++i) {
+    index[i] = cv::borderInterpolate(i - anchor_x,
+                                     input.cols,
+                                     cv::BorderTypes::BORDER_REFLECT);
+  }
+
+  // Every stripe owns its column sums over the kernel rows, followed by their
+  // prefix sums, and its row of the mean image
+  const auto stripe_count = GetStripeCount(input.rows);
+  auto stripe_buffers     = AcquireBuffer(
+    workspace,
+    WorkspaceSlot::kStripeBuffers,
+    cv::Size{static_cast<int>(width + padded_width + 1), stripe_count},
+    CV_64FC1);
+  auto mean_rows = AcquireBuffer(workspace,
+                                 WorkspaceSlot::kMeanRows,
+                                 cv::Size{input.cols, stripe_count},
+                                 CV_8UC1);
+
+  BuildJointHistogram(
+    input.rows,
+    histogram,
+    workspace,
+    [&input,
+     &kernel_size,
+     &column_indices,
+     &stripe_buffers,
+     &mean_rows,
+     &anchor_y,
+     &width,
+     &padded_width,
+     &inverse_area](const int stripe,
+                    const cv::Range& rows,
+                    uint32_t* bins) {
+      const auto* indices = column_indices.ptr<int>(0);
+
+      auto* column_sums = stripe_buffers.ptr<double>(stripe);
+      auto* row_prefix  = column_sums + width;
+      auto* mean        = mean_rows.ptr<GrayscalePixel>(stripe);
+      std::fill_n(column_sums, width, 0.0);
+      row_prefix[0] = 0.0;
+
+      // rows in [y - anchor_y, y - anchor_y + kernel height - 1]
+      for (auto y = rows.start - anchor_y;
+           y < rows.start - anchor_y + kernel_size.height;
+           ++y) {
+        AccumulateColumnSums(input, y, 1.0, column_sums);
+      }
+
+      for (auto y = rows.start; y < rows.end; ++y) {
+        if (y != rows.start) {
+          AccumulateColumnSums(input,
+                               y - anchor_y + kernel_size.height - 1,
+                               1.0,
+                               column_sums);
+          AccumulateColumnSums(input, y - anchor_y - 1, -1.0, column_sums);
+        }
+
+        for (size_t i = 0; i < padded_width; ++i) {
+          row_prefix[i + 1] =
+            row_prefix[i] + column_sums[static_cast<size_t>(indices[i])];
+        }
+
+        // columns in [x - anchor_x, x - anchor_x + kernel width - 1]
+        const auto* sums_end = row_prefix + kernel_size.width;
+        for (size_t x = 0; x < width; ++x) {
+          mean[x] = cv::saturate_cast<GrayscalePixel>(
+            (sums_end[x] - row_prefix[x]) * inverse_area);
+        }
+
+        CountRow(input.ptr<GrayscalePixel>(y), mean, width, bins);
+      }
+    });
+}
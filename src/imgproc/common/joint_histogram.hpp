@@ -0,0 +1,39 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_JOINT_HISTOGRAM_HPP_
+#define IMGPROC_COMMON_JOINT_HISTOGRAM_HPP_
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/binarization_workspace.hpp"
+
+namespace longlp::imgproc {
+
+  // Bins of each dimension of a joint histogram, one per gray level
+  inline constexpr auto kJointHistogramSize = 256;
+
+  // |histogram| is created as kJointHistogramSize x kJointHistogramSize
+  // CV_64F, histogram(i, j) counting the positions where the 8-bit |first|
+  // is i and the 8-bit |second| is j.
+  //
+  // Both planes are read directly, without merging them: every stripe of
+  // rows counts into its own integer histogram, taken from |workspace| when
+  // it is not null, and the stripes are summed at the end.
+  void MakeJointHistogram(const cv::Mat& first,
+                          const cv::Mat& second,
+                          cv::Mat& histogram,
+                          BinarizationWorkspace* workspace);
+
+  // MakeJointHistogram of |input| and of its mean image, the same as
+  // cv::blur(input, mean, kernel_size, {-1, -1}, cv::BORDER_REFLECT), which
+  // is computed row by row within the same pass and never stored
+  void MakeJointHistogramWithMean(const cv::Mat& input,
+                                  const cv::Size& kernel_size,
+                                  cv::Mat& histogram,
+                                  BinarizationWorkspace* workspace);
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_JOINT_HISTOGRAM_HPP_
@@ -0,0 +1,72 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_LOCAL_SUMS_HPP_
+#define IMGPROC_COMMON_LOCAL_SUMS_HPP_
+
+#include <algorithm>   // std::clamp
+#include <array>       // LocalSums
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/constant.hpp"
+
+namespace longlp::imgproc {
+
+  // Sums of the input pixels covered by the kernel window of one pixel:
+  // - local_sums[0]: sum(I)
+  // - local_sums[1]: sum(I * I)
+  template <size_t Order>
+  using LocalSums = std::array<double, Order>;
+
+  // LocalSums of a whole row: local_sums_rows[order][x] is
+  // LocalSums<Order>[order] of the pixel at column x
+  template <size_t Order>
+  using LocalSumsRows = std::array<const double*, Order>;
+
+  // Processor contract shared by every local sums calculator
+  // (IntegralImageCalculator, ChungkwongChanIntegralImageCalculator), so that
+  // a binarization method can switch calculator without touching its kernel.
+  // |pixel| is the input pixel, the returned value is the output pixel.
+  template <class Processor, size_t Order>
+  concept LocalSumsProcessor = requires(Processor&& processor,
+                                        const GrayscalePixel pixel,
+                                        const int* position,
+                                        const LocalSums<Order>& local_sums) {
+    {
+      processor(pixel, position, local_sums)
+      } -> std::same_as<GrayscalePixel>;
+  };
+
+  // Row processor contract shared by every local sums calculator, |y| is the
+  // index of the row in the input
+  template <class RowProcessor, size_t Order>
+  concept LocalSumsRowProcessor =
+    requires(RowProcessor&& row_processor,
+             const int y,
+             const LocalSumsRows<Order>& local_sums_rows) {
+    { row_processor(y, local_sums_rows) } -> std::same_as<void>;
+  };
+
+  // Number of stripes the rows of an image of |rows| rows are split into, one
+  // per worker thread
+  inline auto GetStripeCount(const int rows) -> int {
+    return std::clamp(cv::getNumThreads(), 1, std::max(rows, 1));
+  }
+
+  // Rows of the stripe |stripe| out of |stripe_count| stripes of |rows| rows
+  inline auto GetStripeRows(const int stripe,
+                            const int stripe_count,
+                            const int rows) noexcept -> cv::Range {
+    const auto begin = static_cast<int64_t>(rows) * stripe / stripe_count;
+    const auto end   = static_cast<int64_t>(rows) * (stripe + 1) / stripe_count;
+    return cv::Range{static_cast<int>(begin), static_cast<int>(end)};
+  }
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_LOCAL_SUMS_HPP_
@@ -0,0 +1,22 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_MAT_OVERLAP_HPP_
+#define IMGPROC_COMMON_MAT_OVERLAP_HPP_
+
+#include <opencv2/core.hpp>
+
+namespace longlp::imgproc {
+
+  // Whether the data of |lhs| and |rhs| overlap, e.g. a matrix and one of its
+  // ROI
+  inline auto SharesData(const cv::Mat& lhs, const cv::Mat& rhs) noexcept
+    -> bool {
+    return lhs.datastart != nullptr && rhs.datastart != nullptr &&
+           lhs.datastart < rhs.dataend && rhs.datastart < lhs.dataend;
+  }
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_MAT_OVERLAP_HPP_
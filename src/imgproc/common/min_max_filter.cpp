@@ -0,0 +1,504 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/common/min_max_filter.hpp"
+
+#include <algorithm>   // std::min, std::max, std::fill_n, std::copy_n
+#include <cstddef>
+
+#include "imgproc/common/local_sums.hpp"
+
+namespace {
+  using longlp::imgproc::BinarizationStage;
+  using longlp::imgproc::BinarizationWorkspace;
+  using longlp::imgproc::GrayscalePixel;
+  using longlp::imgproc::kGrayscaleMax;
+  using longlp::imgproc::kGrayscaleMin;
+  using longlp::imgproc::MinMaxFilter;
+  using longlp::imgproc::ScopedStageTimer;
+  using longlp::imgproc::WorkspaceSlot;
+
+  using ErrorCode = cv::Error::Code;
+
+  // |kIdentity| is the value of the pixels outside the input, as
+  // cv::morphologyDefaultBorderValue() does
+  struct MinOperation {
+    static constexpr GrayscalePixel kIdentity = kGrayscaleMax;
+
+    static auto Apply(const GrayscalePixel lhs,
+                      const GrayscalePixel rhs) noexcept -> GrayscalePixel {
+      return std::min(lhs, rhs);
+    }
+  };
+
+  struct MaxOperation {
+    static constexpr GrayscalePixel kIdentity = kGrayscaleMin;
+
+    static auto Apply(const GrayscalePixel lhs,
+                      const GrayscalePixel rhs) noexcept -> GrayscalePixel {
+      return std::max(lhs, rhs);
+    }
+  };
+
+  // Rows of padded_width pixels used to filter one input row: the row padded
+  // with kernel_width - 1 identity pixels, and its block scans
+  struct LineBuffers {
+    GrayscalePixel* padded;
+    GrayscalePixel* prefixes;
+    GrayscalePixel* suffixes;
+    size_t padded_width;
+
+    static constexpr size_t kRowCount = 3;
+
+    LineBuffers(GrayscalePixel* data, const size_t size) noexcept :
+      padded{data},
+      prefixes{data + size},
+      suffixes{data + 2 * size},
+      padded_width{size} {}
+  };
+
+  // van Herk / Gil-Werman: values are split into blocks of |length|,
+  // prefixes[i] (suffixes[i]) reduces its block from the start up to i (from
+  // i up to the end), so that any window of |length| values starting at i
+  // reduces to Apply(suffixes[i], prefixes[i + length - 1])
+  template <class Operation>
+  void ScanBlocks(const GrayscalePixel* values,
+                  const size_t size,
+                  const size_t length,
+                  GrayscalePixel* prefixes,
+                  GrayscalePixel* suffixes) noexcept {
+    for (size_t begin = 0; begin < size; begin += length) {
+      const auto end = std::min(begin + length, size);
+
+      prefixes[begin] = values[begin];
+      for (auto i = begin + 1; i < end; ++i) {
+        prefixes[i] = Operation::Apply(prefixes[i - 1], values[i]);
+      }
+
+      suffixes[end - 1] = values[end - 1];
+      for (auto i = end - 1; i > begin; --i) {
+        suffixes[i - 1] = Operation::Apply(suffixes[i], values[i - 1]);
+      }
+    }
+  }
+
+  // buffers.padded = identity pixels, |pixels|, identity pixels, with
+  // |left_padding| pixels on the left
+  template <class Operation>
+  void PadRow(const GrayscalePixel* pixels,
+              const size_t width,
+              const size_t left_padding,
+              const LineBuffers& buffers) noexcept {
+    std::fill_n(buffers.padded, left_padding, Operation::kIdentity);
+    std::copy_n(pixels, width, buffers.padded + left_padding);
+    std::fill_n(buffers.padded + left_padding + width,
+                buffers.padded_width - left_padding - width,
+                Operation::kIdentity);
+  }
+
+  // output[x] = Operation of the |length| pixels of the row from x - anchor_x
+  // + column, pixels outside the row ignored
+  template <class Operation>
+  void FilterRowHorizontally(const GrayscalePixel* pixels,
+                             const size_t width,
+                             const size_t anchor_x,
+                             const size_t column,
+                             const size_t length,
+                             const LineBuffers& buffers,
+                             GrayscalePixel* output) noexcept {
+    PadRow<Operation>(pixels, width, anchor_x, buffers);
+    ScanBlocks<Operation>(buffers.padded,
+                          buffers.padded_width,
+                          length,
+                          buffers.prefixes,
+                          buffers.suffixes);
+
+    const auto* suffixes = buffers.suffixes + column;
+    const auto* prefixes = buffers.prefixes + column + length - 1;
+    for (size_t x = 0; x < width; ++x) {
+      output[x] = Operation::Apply(suffixes[x], prefixes[x]);
+    }
+  }
+
+  // Row |row| of the output over any structuring element: every chord
+  // reduces the input row it covers with one van Herk / Gil-Werman pass
+  template <class Operation>
+  void FilterRowWithChords(const cv::Mat& input,
+                           const int row,
+                           const cv::Mat& chords,
+                           const cv::Point& anchor,
+                           const LineBuffers& buffers,
+                           GrayscalePixel* output) noexcept {
+    const auto width = static_cast<size_t>(input.cols);
+    std::fill_n(output, width, Operation::kIdentity);
+
+    auto padded_kernel_row = -1;
+    auto scanned_length    = size_t{0};
+    for (auto i = 0; i < chords.cols; ++i) {
+      const auto& chord     = chords.at<cv::Vec3i>(0, i);
+      const auto kernel_row = chord[0];
+      const auto column     = static_cast<size_t>(chord[1]);
+      const auto length     = static_cast<size_t>(chord[2]);
+
+      // rows outside the input are made of identity pixels
+      const auto y = row - anchor.y + kernel_row;
+      if (y < 0 || y >= input.rows) {
+        continue;
+      }
+
+      if (kernel_row != padded_kernel_row) {
+        PadRow<Operation>(input.ptr<GrayscalePixel>(y),
+                          width,
+                          static_cast<size_t>(anchor.x),
+                          buffers);
+        padded_kernel_row = kernel_row;
+        scanned_length    = 0;
+      }
+      if (length != scanned_length) {
+        ScanBlocks<Operation>(buffers.padded,
+                              buffers.padded_width,
+                              length,
+                              buffers.prefixes,
+                              buffers.suffixes);
+        scanned_length = length;
+      }
+
+      const auto* suffixes = buffers.suffixes + column;
+      const auto* prefixes = buffers.prefixes + column + length - 1;
+      for (size_t x = 0; x < width; ++x) {
+        output[x] = Operation::Apply(
+          output[x],
+          Operation::Apply(suffixes[x], prefixes[x]));
+      }
+    }
+  }
+
+  // Vertical pass over a kernel_size rectangle, separable: every input row is
+  // reduced horizontally once into |block|, then the windows of kernel height
+  // rows are reduced with van Herk / Gil-Werman across blocks of kernel
+  // height rows. |data| holds kRowCount x kernel height rows of input.cols
+  // pixels.
+  template <class Operation>
+  class RectangleScans {
+   public:
+    static constexpr size_t kRowCount = 3;
+
+    RectangleScans(const cv::Mat& input,
+                   const cv::Size& kernel_size,
+                   const cv::Point& anchor,
+                   const LineBuffers& buffers,
+                   GrayscalePixel* data) noexcept :
+      input_{input},
+      kernel_size_{kernel_size},
+      anchor_{anchor},
+      buffers_{buffers},
+      width_{static_cast<size_t>(input.cols)},
+      height_{static_cast<size_t>(kernel_size.height)},
+      block_{data},
+      prefixes_{data + height_ * width_},
+      suffixes_{data + 2 * height_ * width_} {}
+
+    // block = horizontal reductions of the input rows from |first_row|, rows
+    // outside the input are made of identity pixels
+    void LoadBlock(const int first_row) const noexcept {
+      for (size_t i = 0; i < height_; ++i) {
+        auto* reduced = block_ + i * width_;
+        const auto y  = first_row + static_cast<int>(i);
+        if (y < 0 || y >= input_.rows) {
+          std::fill_n(reduced, width_, Operation::kIdentity);
+          continue;
+        }
+        FilterRowHorizontally<Operation>(
+          input_.ptr<GrayscalePixel>(y),
+          width_,
+          static_cast<size_t>(anchor_.x),
+          0,
+          static_cast<size_t>(kernel_size_.width),
+          buffers_,
+          reduced);
+      }
+    }
+
+    // suffixes[i] reduces the rows of the block from i to its end
+    void ScanSuffixes() const noexcept {
+      const auto last = (height_ - 1) * width_;
+      std::copy_n(block_ + last, width_, suffixes_ + last);
+      for (auto i = height_ - 1; i > 0; --i) {
+        auto* above        = suffixes_ + (i - 1) * width_;
+        const auto* below  = suffixes_ + i * width_;
+        const auto* pixels = block_ + (i - 1) * width_;
+        for (size_t x = 0; x < width_; ++x) {
+          above[x] = Operation::Apply(below[x], pixels[x]);
+        }
+      }
+    }
+
+    // prefixes[i] reduces the rows of the block from its start to i
+    void ScanPrefixes() const noexcept {
+      std::copy_n(block_, width_, prefixes_);
+      for (size_t i = 1; i < height_; ++i) {
+        const auto* above  = prefixes_ + (i - 1) * width_;
+        const auto* pixels = block_ + i * width_;
+        auto* below        = prefixes_ + i * width_;
+        for (size_t x = 0; x < width_; ++x) {
+          below[x] = Operation::Apply(above[x], pixels[x]);
+        }
+      }
+    }
+
+    // Window starting at the row |i| of the previous block, whose suffixes
+    // are scanned, and ending at the row i - 1 of the loaded block, whose
+    // prefixes are scanned. Either points into the scans or is |output|.
+    auto ReduceWindow(const size_t i, GrayscalePixel* output) const noexcept
+      -> const GrayscalePixel* {
+      const auto* suffix = suffixes_ + i * width_;
+      if (i == 0) {
+        return suffix;
+      }
+      const auto* prefix = prefixes_ + (i - 1) * width_;
+      for (size_t x = 0; x < width_; ++x) {
+        output[x] = Operation::Apply(suffix[x], prefix[x]);
+      }
+      return output;
+    }
+
+   private:
+    const cv::Mat& input_;
+    cv::Size kernel_size_;
+    cv::Point anchor_;
+    LineBuffers buffers_;
+    size_t width_;
+    size_t height_;
+    GrayscalePixel* block_;
+    GrayscalePixel* prefixes_;
+    GrayscalePixel* suffixes_;
+  };
+}   // namespace
+
+MinMaxFilter::MinMaxFilter(const cv::Mat& kernel,
+                           BinarizationWorkspace* workspace) :
+  workspace_{workspace},
+  kernel_size_{kernel.size()},
+  anchor_{kernel.cols / 2, kernel.rows / 2} {
+  // pre-conditions
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if (kernel.empty() || kernel.dims != 2 || kernel.type() != CV_8UC1) {
+    CV_Error(ErrorCode::StsBadArg,
+             "kernel must be 2D, 8-bit, single channel and not empty");
+  }
+
+  auto chord_count = 0;
+  for (auto y = 0; y < kernel.rows; ++y) {
+    const auto* elements = kernel.ptr<uint8_t>(y);
+    for (auto x = 0; x < kernel.cols; ++x) {
+      if (elements[x] != 0 && (x == 0 || elements[x - 1] == 0)) {
+        ++chord_count;
+      }
+    }
+  }
+
+  chords_ = AcquireBuffer(workspace_,
+                          WorkspaceSlot::kStructuringElementChords,
+                          cv::Size{chord_count, 1},
+                          CV_32SC3);
+
+  auto chord = 0;
+  for (auto y = 0; y < kernel.rows; ++y) {
+    const auto* elements = kernel.ptr<uint8_t>(y);
+    for (auto x = 0; x < kernel.cols;) {
+      if (elements[x] == 0) {
+        ++x;
+        continue;
+      }
+      const auto begin = x;
+      while (x < kernel.cols && elements[x] != 0) {
+        ++x;
+      }
+      chords_.at<cv::Vec3i>(0, chord++) = cv::Vec3i{y, begin, x - begin};
+    }
+  }
+
+  is_rectangle_ = chord_count == kernel.rows &&
+                  cv::countNonZero(kernel) == kernel.rows * kernel.cols;
+}
+
+void MinMaxFilter::Apply(const cv::Mat& input,
+                         cv::Mat& min_output,
+                         cv::Mat& max_output) const {
+  // pre-conditions
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if (input.type() != CV_8UC1 || input.dims != 2) {
+    CV_Error(ErrorCode::StsBadArg,
+             "input must be 2D image, 8-bit, single channel");
+  }
+
+  const ScopedStageTimer timer{GetStats(workspace_),
+                               BinarizationStage::kMorphology,
+                               input.total()};
+
+  min_output.create(input.size(), CV_8UC1);
+  max_output.create(input.size(), CV_8UC1);
+
+  // Every stripe of rows owns its scratch rows
+  const auto stripe_count = GetStripeCount(input.rows);
+  auto stripe_buffers     = AcquireBuffer(
+    workspace_,
+    WorkspaceSlot::kMinMaxFilterBuffers,
+    cv::Size{static_cast<int>(GetStripeBufferSize(input.cols)),
+             stripe_count},
+    CV_8UC1);
+
+  cv::parallel_for_(
+    cv::Range{0, stripe_count},
+    [this,
+     &input,
+     &min_output,
+     &max_output,
+     &stripe_buffers,
+     &stripe_count](const cv::Range& stripes) {
+      const auto width = static_cast<size_t>(input.cols);
+      for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+        ApplyRows(input,
+                  GetStripeRows(stripe, stripe_count, input.rows),
+                  stripe_buffers.ptr<GrayscalePixel>(stripe),
+                  [&min_output, &max_output, width](
+                    const int y,
+                    const GrayscalePixel* min_row,
+                    const GrayscalePixel* max_row) {
+                    std::copy_n(min_row,
+                                width,
+                                min_output.ptr<GrayscalePixel>(y));
+                    std::copy_n(max_row,
+                                width,
+                                max_output.ptr<GrayscalePixel>(y));
+                  });
+      }
+    },
+    static_cast<double>(stripe_count));
+}
+
+void MinMaxFilter::ApplyRows(const cv::Mat& input,
+                             const cv::Range& rows,
+                             GrayscalePixel* buffer,
+                             const RowCallback& on_row) const {
+  const auto width        = static_cast<size_t>(input.cols);
+  const auto padded_width = width + static_cast<size_t>(kernel_size_.width) - 1;
+
+  const LineBuffers buffers{buffer, padded_width};
+  auto* min_row = buffer + LineBuffers::kRowCount * padded_width;
+  auto* max_row = min_row + width;
+  auto* scans   = max_row + width;
+
+  if (!is_rectangle_) {
+    for (auto y = rows.start; y < rows.end; ++y) {
+      FilterRowWithChords<MinOperation>(input,
+                                        y,
+                                        chords_,
+                                        anchor_,
+                                        buffers,
+                                        min_row);
+      FilterRowWithChords<MaxOperation>(input,
+                                        y,
+                                        chords_,
+                                        anchor_,
+                                        buffers,
+                                        max_row);
+      on_row(y, min_row, max_row);
+    }
+    return;
+  }
+
+  const auto height = static_cast<size_t>(kernel_size_.height);
+  const RectangleScans<MinOperation> min_scans{input,
+                                               kernel_size_,
+                                               anchor_,
+                                               buffers,
+                                               scans};
+  const RectangleScans<MaxOperation> max_scans{
+    input,
+    kernel_size_,
+    anchor_,
+    buffers,
+    scans + RectangleScans<MinOperation>::kRowCount * height * width};
+
+  // the window of the output row y holds the input rows from y - anchor.y
+  const auto first_window_row = rows.start - anchor_.y;
+
+  min_scans.LoadBlock(first_window_row);
+  min_scans.ScanSuffixes();
+  max_scans.LoadBlock(first_window_row);
+  max_scans.ScanSuffixes();
+
+  for (auto block_row = first_window_row; block_row + anchor_.y < rows.end;
+       block_row += kernel_size_.height) {
+    min_scans.LoadBlock(block_row + kernel_size_.height);
+    min_scans.ScanPrefixes();
+    max_scans.LoadBlock(block_row + kernel_size_.height);
+    max_scans.ScanPrefixes();
+
+    for (size_t i = 0; i < height; ++i) {
+      const auto y = block_row + static_cast<int>(i) + anchor_.y;
+      if (y >= rows.end) {
+        break;
+      }
+      on_row(y,
+             min_scans.ReduceWindow(i, min_row),
+             max_scans.ReduceWindow(i, max_row));
+    }
+
+    min_scans.ScanSuffixes();
+    max_scans.ScanSuffixes();
+  }
+}
+
+auto MinMaxFilter::GetStripeBufferSize(const int width) const noexcept
+  -> size_t {
+  const auto columns = static_cast<size_t>(width);
+  const auto padded_width =
+    columns + static_cast<size_t>(kernel_size_.width) - 1;
+
+  auto size = LineBuffers::kRowCount * padded_width + 2 * columns;
+  if (is_rectangle_) {
+    size += 2 * RectangleScans<MinOperation>::kRowCount *
+            static_cast<size_t>(kernel_size_.height) * columns;
+  }
+  return size;
+}
+
+void MinMaxFilter::ApplyRow(const cv::Mat& rows,
+                            const int row,
+                            GrayscalePixel* min_row,
+                            GrayscalePixel* max_row) const {
+  // pre-conditions
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if (rows.type() != CV_8UC1 || rows.dims != 2) {
+    CV_Error(ErrorCode::StsBadArg,
+             "rows must be 2D image, 8-bit, single channel");
+  }
+  if (row < 0 || row >= rows.rows) {
+    CV_Error(ErrorCode::StsOutOfRange, "row is out of rows");
+  }
+
+  const auto padded_width =
+    static_cast<size_t>(rows.cols + kernel_size_.width - 1);
+  auto scratch = AcquireBuffer(
+    workspace_,
+    WorkspaceSlot::kMinMaxFilterBuffers,
+    cv::Size{static_cast<int>(LineBuffers::kRowCount * padded_width), 1},
+    CV_8UC1);
+  const LineBuffers buffers{scratch.ptr<GrayscalePixel>(0), padded_width};
+
+  FilterRowWithChords<MinOperation>(rows,
+                                    row,
+                                    chords_,
+                                    anchor_,
+                                    buffers,
+                                    min_row);
+  FilterRowWithChords<MaxOperation>(rows,
+                                    row,
+                                    chords_,
+                                    anchor_,
+                                    buffers,
+                                    max_row);
+}
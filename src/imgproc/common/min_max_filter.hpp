@@ -0,0 +1,86 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_MIN_MAX_FILTER_HPP_
+#define IMGPROC_COMMON_MIN_MAX_FILTER_HPP_
+
+#include <cstddef>
+#include <functional>   // RowCallback
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/binarization_workspace.hpp"
+#include "imgproc/common/constant.hpp"
+
+namespace longlp::imgproc {
+
+  // Local min and max of 8-bit images over a structuring element, identical
+  // to cv::erode and cv::dilate with the anchor at the kernel center and the
+  // pixels outside the input ignored (BORDER_CONSTANT with
+  // cv::morphologyDefaultBorderValue()).
+  //
+  // The structuring element is split into chords, the horizontal runs of its
+  // non-zero elements. The min/max of every run of length L along a row costs
+  // 3 comparisons per pixel whatever L (van Herk / Gil-Werman), so per pixel:
+  // - rectangular kernels, separable: O(1)
+  // - any other kernel: O(number of chords), i.e. O(kernel height) for convex
+  //   shapes such as ellipses, instead of O(kernel area)
+  class MinMaxFilter {
+   public:
+    // |min_row| and |max_row| are the min and max of the output row |y|, only
+    // valid during the call
+    using RowCallback = std::function<void(int y,
+                                           const GrayscalePixel* min_row,
+                                           const GrayscalePixel* max_row)>;
+
+    // |kernel| is an 8-bit, single channel structuring element whose
+    // non-zero elements are the neighborhood. Temporaries are taken from
+    // |workspace| when it is not null.
+    MinMaxFilter(const cv::Mat& kernel, BinarizationWorkspace* workspace);
+
+    // |min_output| and |max_output| are created with the size of the 8-bit
+    // |input|, neither must share data with |input|
+    void Apply(const cv::Mat& input,
+               cv::Mat& min_output,
+               cv::Mat& max_output) const;
+
+    // Streams the min and max of the output rows |rows| to |on_row|, in
+    // order, without materializing the output images. |buffer| is
+    // GetStripeBufferSize(input.cols) bytes of scratch owned by the caller,
+    // so that stripes of rows can run in parallel.
+    void ApplyRows(const cv::Mat& input,
+                   const cv::Range& rows,
+                   GrayscalePixel* buffer,
+                   const RowCallback& on_row) const;
+
+    [[nodiscard]] auto GetStripeBufferSize(int width) const noexcept
+      -> size_t;
+
+    // Min and max of the row |row| of |rows| into |min_row| and |max_row| of
+    // rows.cols pixels: pixels out of |rows| are ignored as if |rows| were
+    // the whole input
+    void ApplyRow(const cv::Mat& rows,
+                  int row,
+                  GrayscalePixel* min_row,
+                  GrayscalePixel* max_row) const;
+
+    // Every element of the kernel is non-zero
+    [[nodiscard]] auto is_rectangle() const noexcept -> bool {
+      return is_rectangle_;
+    }
+
+   private:
+    BinarizationWorkspace* workspace_;
+    cv::Size kernel_size_;
+    cv::Point anchor_;
+
+    // 1 x chord count, CV_32SC3: kernel row, first kernel column, length,
+    // sorted by kernel row
+    cv::Mat chords_;
+    bool is_rectangle_{};
+  };
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_MIN_MAX_FILTER_HPP_
@@ -0,0 +1,119 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/common/packed_binary_image.hpp"
+
+#include <algorithm>   // std::min, std::fill
+#include <bit>         // std::endian
+#include <cstring>     // std::memcpy
+
+#include <opencv2/core/hal/intrin.hpp>
+
+#include "imgproc/common/local_sums.hpp"
+
+namespace {
+  using longlp::imgproc::GetStripeCount;
+  using longlp::imgproc::GetStripeRows;
+  using longlp::imgproc::GrayscalePixel;
+  using longlp::imgproc::PackedBinaryImage;
+
+  using ErrorCode = cv::Error::Code;
+
+  constexpr auto kWordBits = PackedBinaryImage::kWordBits;
+
+#if CV_SIMD
+  // Reverses the bits of every byte of |word|
+  auto ReverseByteBits(uint64_t word) noexcept -> uint64_t {
+    word = (word & 0xF0F0F0F0F0F0F0F0U) >> 4U |
+           (word & 0x0F0F0F0F0F0F0F0FU) << 4U;
+    word = (word & 0xCCCCCCCCCCCCCCCCU) >> 2U |
+           (word & 0x3333333333333333U) << 2U;
+    return (word & 0xAAAAAAAAAAAAAAAAU) >> 1U |
+           (word & 0x5555555555555555U) << 1U;
+  }
+#endif
+}   // namespace
+
+void longlp::imgproc::PackBinaryRow(const GrayscalePixel* pixels,
+                                    const size_t width,
+                                    uint8_t* packed) noexcept {
+  size_t x = 0;
+#if CV_SIMD
+  static_assert(std::endian::native == std::endian::little,
+                "the sign masks are stored as little-endian words");
+
+  // the sign mask of one vector of pixels fills |lanes| bits of a word, the
+  // pixel x % 64 at the bit x % 64, |lanes| divides 64
+  const auto lanes = static_cast<size_t>(cv::VTraits<cv::v_uint8>::vlanes());
+  const auto lanes_mask =
+    lanes < kWordBits ? (uint64_t{1} << lanes) - 1 : ~uint64_t{0};
+  const auto zero = cv::vx_setzero_u8();
+
+  for (; x + kWordBits <= width; x += kWordBits) {
+    uint64_t word = 0;
+    for (size_t lane = 0; lane < kWordBits; lane += lanes) {
+      const auto is_black = cv::v_eq(cv::vx_load(pixels + x + lane), zero);
+      word |= (static_cast<uint64_t>(cv::v_signmask(is_black)) & lanes_mask)
+              << lane;
+    }
+
+    // byte k holds the pixels [8 k, 8 k + 8) from its LSB, MSB-first after
+    // reversal
+    word = ReverseByteBits(word);
+    std::memcpy(packed + x / 8, &word, sizeof(word));
+  }
+#endif
+  for (; x < width; x += 8) {
+    const auto end = std::min(width, x + 8);
+
+    uint8_t byte = 0;
+    for (auto i = x; i < end; ++i) {
+      byte |= static_cast<uint8_t>((pixels[i] == 0 ? 0x80U : 0U) >> (i - x));
+    }
+    packed[x / 8] = byte;
+  }
+}
+
+void PackedBinaryImage::Create(const cv::Size& size) {
+  size_ = size;
+  words_.create(size.height,
+                static_cast<int>(words_per_row() * sizeof(uint64_t)),
+                CV_8UC1);
+
+  for (auto y = 0; y < size.height; ++y) {
+    auto* row_bytes = words_.ptr<uint8_t>(y);
+    std::fill(row_bytes + bytes_per_row(),
+              row_bytes + words_per_row() * sizeof(uint64_t),
+              uint8_t{0});
+  }
+}
+
+void PackedBinaryImage::Pack(const cv::Mat& image) {
+  // pre-conditions
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if (image.type() != CV_8UC1 || image.dims != 2) {
+    CV_Error(ErrorCode::StsBadArg,
+             "image must be 2D image, 8-bit, single channel");
+  }
+
+  Create(image.size());
+
+  const auto stripe_count = GetStripeCount(image.rows);
+  cv::parallel_for_(
+    cv::Range{0, stripe_count},
+    [this, &image, &stripe_count](const cv::Range& stripes) {
+      const auto width = static_cast<size_t>(image.cols);
+
+      for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+        const auto rows = GetStripeRows(stripe, stripe_count, image.rows);
+        for (auto y = rows.start; y < rows.end; ++y) {
+          PackBinaryRow(image.ptr<GrayscalePixel>(y), width, bytes(y));
+        }
+      }
+#if CV_SIMD
+      cv::vx_cleanup();
+#endif
+    },
+    static_cast<double>(stripe_count));
+}
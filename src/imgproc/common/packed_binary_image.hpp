@@ -0,0 +1,79 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_PACKED_BINARY_IMAGE_HPP_
+#define IMGPROC_COMMON_PACKED_BINARY_IMAGE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/constant.hpp"
+
+namespace longlp::imgproc {
+
+  // packed[x / 8] bit 7 - x % 8 = pixels[x] == 0 for the |width| pixels of a
+  // row, the bits past the last pixel of the last byte are 0
+  void PackBinaryRow(const GrayscalePixel* pixels,
+                     size_t width,
+                     uint8_t* packed) noexcept;
+
+  // Binary image with one bit per pixel, set for the black pixels (0 in the
+  // 8-bit image). Rows are laid out as in binary PBM and CCITT fax images:
+  // MSB-first bytes, see PackBinaryRow, padded with 0 bits to whole 64-bit
+  // words so that they can also be combined and counted a word at a time.
+  class PackedBinaryImage {
+   public:
+    static constexpr size_t kWordBits = 64;
+
+    PackedBinaryImage() = default;
+
+    explicit PackedBinaryImage(const cv::Mat& image) {
+      Pack(image);
+    }
+
+    // Rows of |size| to be written through bytes(), with their padding
+    // already 0. The storage is only reallocated when it does not fit.
+    void Create(const cv::Size& size);
+
+    // Packs |image|, a 2D, 8-bit, single channel image
+    void Pack(const cv::Mat& image);
+
+    [[nodiscard]] auto size() const noexcept -> cv::Size {
+      return size_;
+    }
+
+    // bytes of a row holding pixels, as in a PBM row
+    [[nodiscard]] auto bytes_per_row() const noexcept -> size_t {
+      return (static_cast<size_t>(size_.width) + 7) / 8;
+    }
+
+    [[nodiscard]] auto words_per_row() const noexcept -> size_t {
+      return (static_cast<size_t>(size_.width) + kWordBits - 1) / kWordBits;
+    }
+
+    [[nodiscard]] auto bytes(const int y) const -> const uint8_t* {
+      return words_.ptr<uint8_t>(y);
+    }
+
+    [[nodiscard]] auto bytes(const int y) -> uint8_t* {
+      return words_.ptr<uint8_t>(y);
+    }
+
+    // The bytes of a row read as little-endian words
+    [[nodiscard]] auto row(const int y) const -> const uint64_t* {
+      return words_.ptr<uint64_t>(y);
+    }
+
+   private:
+    cv::Size size_{};
+
+    // |words_per_row| words per row, as bytes
+    cv::Mat words_;
+  };
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_PACKED_BINARY_IMAGE_HPP_
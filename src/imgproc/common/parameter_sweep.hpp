@@ -0,0 +1,290 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_PARAMETER_SWEEP_HPP_
+#define IMGPROC_COMMON_PARAMETER_SWEEP_HPP_
+
+#include <algorithm>   // std::min, std::fill
+#include <array>       // thresholds block
+#include <cstddef>
+#include <span>
+#include <vector>   // stripe scores
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include "imgproc/common/binarization_workspace.hpp"
+#include "imgproc/common/constant.hpp"
+#include "imgproc/common/local_sums.hpp"
+#include "imgproc/common/simd_row_kernels.hpp"
+
+namespace longlp::imgproc {
+
+  // Pixel counts of one binarization of a parameter sweep
+  struct SweepScore {
+    // pixels decided as object
+    size_t object_pixels{};
+
+    // pixels decided differently from the ground truth, whose 0 pixels are
+    // object and the others background. 0 without ground truth.
+    size_t mismatched_pixels{};
+  };
+
+  // Binarizes one image with many parameters of a method deciding each pixel
+  // against a threshold of its local mean and standard deviation (NiBlack,
+  // Sauvola). Those only depend on the kernel size: they are computed once
+  // by |LocalSumsCalculator|, then each block of statistics is decided for
+  // every parameter while it is in cache, instead of one full binarization
+  // per parameter.
+  //
+  // The statistics go through simd::ComputeBlockThresholds, so that the
+  // decisions are the same as the kFast binarization.
+  template <class LocalSumsCalculator>
+  class ParameterSweep {
+   public:
+    // |input| must outlive the sweep. Temporaries are taken from |workspace|
+    // when it is not null.
+    ParameterSweep(const cv::Mat& input,
+                   const cv::Size& kernel_size,
+                   BinarizationWorkspace* workspace);
+
+    // outputs[i] = input > thresholds[i](mean, stddev) ? background : object
+    // with the colors of kBinaryColors<UseBackgroundWhiteColor>. |outputs| are
+    // (re)created and must not share data with the input.
+    template <bool UseBackgroundWhiteColor, class ThresholdFunction>
+    void Binarize(std::span<const ThresholdFunction> thresholds,
+                  std::span<cv::Mat> outputs) const;
+
+    // scores[i] of the decisions of thresholds[i], against |ground_truth|
+    // when it is not empty
+    template <class ThresholdFunction>
+    void Score(std::span<const ThresholdFunction> thresholds,
+               const cv::Mat& ground_truth,
+               std::span<SweepScore> scores) const;
+
+   private:
+    // Calls |decide|(stripe, index, y, block, block_size, block_thresholds)
+    // for every block of every row y and every thresholds[index], where
+    // block_thresholds are the thresholds of the pixels [block, block +
+    // block_size) of the row. Stripes of rows run in parallel.
+    template <class ThresholdFunction, class Decide>
+    void ForEachThresholdBlock(std::span<const ThresholdFunction> thresholds,
+                               int stripe_count,
+                               const Decide& decide) const;
+
+    cv::Mat input_;
+
+    // CV_64FC1, local mean and standard deviation of every pixel
+    cv::Mat means_;
+    cv::Mat stddevs_;
+  };
+
+  template <class LocalSumsCalculator>
+  ParameterSweep<LocalSumsCalculator>::ParameterSweep(
+    const cv::Mat& input,
+    const cv::Size& kernel_size,
+    BinarizationWorkspace* workspace) :
+    input_{input},
+    means_{AcquireBuffer(workspace,
+                         WorkspaceSlot::kLocalMeans,
+                         input.size(),
+                         CV_64FC1)},
+    stddevs_{AcquireBuffer(workspace,
+                           WorkspaceSlot::kLocalStddevs,
+                           input.size(),
+                           CV_64FC1)} {
+    const auto area = static_cast<double>(kernel_size.area());
+
+    LocalSumsCalculator::template ConstructIntegralAndIterateRows<2>(
+      input,
+      kernel_size,
+      workspace,
+      [this, &area](const int y, const LocalSumsRows<2>& local_sums_rows) {
+        const auto& [sums, square_sums] = local_sums_rows;
+        const auto width = static_cast<size_t>(input_.cols);
+
+        simd::ComputeBlockThresholds(
+          sums,
+          square_sums,
+          width,
+          area,
+          [](const auto& mean, [[maybe_unused]] const auto& stddev) {
+            return mean;
+          },
+          means_.ptr<double>(y));
+        simd::ComputeBlockThresholds(
+          sums,
+          square_sums,
+          width,
+          area,
+          []([[maybe_unused]] const auto& mean, const auto& stddev) {
+            return stddev;
+          },
+          stddevs_.ptr<double>(y));
+#if CV_SIMD_64F
+        cv::vx_cleanup();
+#endif
+      });
+  }
+
+  template <class LocalSumsCalculator>
+  template <class ThresholdFunction, class Decide>
+  void ParameterSweep<LocalSumsCalculator>::ForEachThresholdBlock(
+    std::span<const ThresholdFunction> thresholds,
+    const int stripe_count,
+    const Decide& decide) const {
+    cv::parallel_for_(
+      cv::Range{0, stripe_count},
+      [this, &thresholds, &stripe_count, &decide](const cv::Range& stripes) {
+        const auto width = static_cast<size_t>(input_.cols);
+
+        std::array<double, simd::kRowBlockSize> block_thresholds{};
+
+        for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+          const auto rows = GetStripeRows(stripe, stripe_count, input_.rows);
+          for (auto y = rows.start; y < rows.end; ++y) {
+            const auto* means   = means_.ptr<double>(y);
+            const auto* stddevs = stddevs_.ptr<double>(y);
+
+            for (size_t block = 0; block < width;
+                 block += simd::kRowBlockSize) {
+              const auto block_size =
+                std::min(simd::kRowBlockSize, width - block);
+
+              for (size_t index = 0; index < thresholds.size(); ++index) {
+                simd::ComputeThresholdsFromMeanStddev(
+                  means + block,
+                  stddevs + block,
+                  block_size,
+                  thresholds[index],
+                  block_thresholds.data());
+                decide(stripe,
+                       index,
+                       y,
+                       block,
+                       block_size,
+                       block_thresholds.data());
+              }
+            }
+          }
+        }
+#if CV_SIMD_64F
+        cv::vx_cleanup();
+#endif
+      },
+      static_cast<double>(stripe_count));
+  }
+
+  template <class LocalSumsCalculator>
+  template <bool UseBackgroundWhiteColor, class ThresholdFunction>
+  void ParameterSweep<LocalSumsCalculator>::Binarize(
+    std::span<const ThresholdFunction> thresholds,
+    std::span<cv::Mat> outputs) const {
+    // pre-conditions
+    if (thresholds.size() != outputs.size()) {
+      CV_Error(cv::Error::Code::StsBadArg,
+               "thresholds and outputs do not have the same count");
+    }
+
+    for (auto& output : outputs) {
+      output.create(input_.size(), CV_8UC1);
+    }
+
+    ForEachThresholdBlock(
+      thresholds,
+      GetStripeCount(input_.rows),
+      [this, &outputs]([[maybe_unused]] const int stripe,
+                       const size_t index,
+                       const int y,
+                       const size_t block,
+                       const size_t block_size,
+                       const double* block_thresholds) {
+        const auto* pixels = input_.ptr<GrayscalePixel>(y) + block;
+        auto* binarized    = outputs[index].ptr<GrayscalePixel>(y) + block;
+
+        // same loop as simd::BinarizeRowWithMeanStddev
+        constexpr auto kColors = kBinaryColors<UseBackgroundWhiteColor>;
+        for (size_t x = 0; x < block_size; ++x) {
+          binarized[x] = static_cast<double>(pixels[x]) > block_thresholds[x]
+                           ? kColors.background
+                           : kColors.object;
+        }
+      });
+  }
+
+  template <class LocalSumsCalculator>
+  template <class ThresholdFunction>
+  void ParameterSweep<LocalSumsCalculator>::Score(
+    std::span<const ThresholdFunction> thresholds,
+    const cv::Mat& ground_truth,
+    std::span<SweepScore> scores) const {
+    // pre-conditions
+    if (thresholds.size() != scores.size()) {
+      CV_Error(cv::Error::Code::StsBadArg,
+               "thresholds and scores do not have the same count");
+    }
+    // NOLINTNEXTLINE(hicpp-signed-bitwise)
+    if (!ground_truth.empty() && (ground_truth.type() != CV_8UC1 ||
+                                  ground_truth.size() != input_.size())) {
+      CV_Error(cv::Error::Code::StsBadArg,
+               "ground truth must be 8-bit, single channel with the size of "
+               "input");
+    }
+
+    // one score per stripe and thresholds, summed up once every stripe is
+    // done
+    const auto stripe_count = GetStripeCount(input_.rows);
+    std::vector<SweepScore> stripe_scores(static_cast<size_t>(stripe_count) *
+                                          thresholds.size());
+
+    ForEachThresholdBlock(
+      thresholds,
+      stripe_count,
+      [this, &thresholds, &ground_truth, &stripe_scores](
+        const int stripe,
+        const size_t index,
+        const int y,
+        const size_t block,
+        const size_t block_size,
+        const double* block_thresholds) {
+        const auto* pixels = input_.ptr<GrayscalePixel>(y) + block;
+        auto& score =
+          stripe_scores[static_cast<size_t>(stripe) * thresholds.size() +
+                        index];
+
+        size_t object_pixels = 0;
+        for (size_t x = 0; x < block_size; ++x) {
+          object_pixels +=
+            static_cast<double>(pixels[x]) > block_thresholds[x] ? 0 : 1;
+        }
+        score.object_pixels += object_pixels;
+
+        if (ground_truth.empty()) {
+          return;
+        }
+        const auto* truth = ground_truth.ptr<GrayscalePixel>(y) + block;
+
+        size_t mismatched_pixels = 0;
+        for (size_t x = 0; x < block_size; ++x) {
+          const auto is_background =
+            static_cast<double>(pixels[x]) > block_thresholds[x];
+          mismatched_pixels += is_background != (truth[x] != 0) ? 1 : 0;
+        }
+        score.mismatched_pixels += mismatched_pixels;
+      });
+
+    std::fill(scores.begin(), scores.end(), SweepScore{});
+    for (size_t stripe = 0; stripe < static_cast<size_t>(stripe_count);
+         ++stripe) {
+      for (size_t index = 0; index < scores.size(); ++index) {
+        const auto& score = stripe_scores[stripe * scores.size() + index];
+        scores[index].object_pixels += score.object_pixels;
+        scores[index].mismatched_pixels += score.mismatched_pixels;
+      }
+    }
+  }
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_PARAMETER_SWEEP_HPP_
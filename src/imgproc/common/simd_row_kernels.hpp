@@ -0,0 +1,213 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_SIMD_ROW_KERNELS_HPP_
+#define IMGPROC_COMMON_SIMD_ROW_KERNELS_HPP_
+
+#include <algorithm>   // std::min
+#include <array>       // thresholds block
+#include <cmath>       // std::sqrt
+#include <cstddef>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include "imgproc/common/constant.hpp"
+#include "imgproc/common/local_sums.hpp"
+#include "imgproc/common/packed_binary_image.hpp"
+#include "imgproc/common/threshold_map.hpp"
+
+namespace longlp::imgproc::simd {
+
+  // Pixels handled per block, so that the thresholds of a block stay on the
+  // stack and in L1
+  inline constexpr size_t kRowBlockSize = 256;
+
+  // thresholds[x] = threshold(mean, stddev) of the |block_size| pixels whose
+  // local sums are |sums| and |square_sums|
+  //
+  // mean and stddev are computed with hardware doubles, the variance as
+  // (area * sum(I * I) - sum(I)^2) / area^2 whose numerator is exact since
+  // the local sums are exact integers, avoiding the cancellation of
+  // sum(I * I) / area - mean^2. |threshold| is called with cv::v_float64
+  // lanes when 64-bit float SIMD is available, and with double for the
+  // remaining pixels of the block.
+  template <class ThresholdFunction>
+  void ComputeBlockThresholds(const double* sums,
+                              const double* square_sums,
+                              const size_t block_size,
+                              const double area,
+                              const ThresholdFunction& threshold,
+                              double* thresholds) noexcept {
+    const auto inverse_area = 1.0 / area;
+
+    size_t x = 0;
+#if CV_SIMD_64F
+    const auto lanes =
+      static_cast<size_t>(cv::VTraits<cv::v_float64>::vlanes());
+    const auto v_area         = cv::vx_setall_f64(area);
+    const auto v_inverse_area = cv::vx_setall_f64(inverse_area);
+
+    for (; x + lanes <= block_size; x += lanes) {
+      const auto sum        = cv::vx_load(sums + x);
+      const auto square_sum = cv::vx_load(square_sums + x);
+
+      const auto mean     = cv::v_mul(sum, v_inverse_area);
+      const auto variance = cv::v_mul(
+        cv::v_sub(cv::v_mul(square_sum, v_area), cv::v_mul(sum, sum)),
+        cv::v_mul(v_inverse_area, v_inverse_area));
+
+      cv::v_store(thresholds + x, threshold(mean, cv::v_sqrt(variance)));
+    }
+#endif
+    for (; x < block_size; ++x) {
+      const auto sum        = sums[x];
+      const auto square_sum = square_sums[x];
+
+      const auto mean     = sum * inverse_area;
+      const auto variance = (square_sum * area - sum * sum) *
+                            (inverse_area * inverse_area);
+
+      thresholds[x] = threshold(mean, std::sqrt(variance));
+    }
+  }
+
+  // thresholds[x] = threshold(means[x], stddevs[x]) of |size| pixels whose
+  // local mean and standard deviation are already known, |threshold| is
+  // called as by ComputeBlockThresholds
+  template <class ThresholdFunction>
+  void ComputeThresholdsFromMeanStddev(const double* means,
+                                       const double* stddevs,
+                                       const size_t size,
+                                       const ThresholdFunction& threshold,
+                                       double* thresholds) noexcept {
+    size_t x = 0;
+#if CV_SIMD_64F
+    const auto lanes =
+      static_cast<size_t>(cv::VTraits<cv::v_float64>::vlanes());
+    for (; x + lanes <= size; x += lanes) {
+      cv::v_store(thresholds + x,
+                  threshold(cv::vx_load(means + x), cv::vx_load(stddevs + x)));
+    }
+#endif
+    for (; x < size; ++x) {
+      thresholds[x] = threshold(means[x], stddevs[x]);
+    }
+  }
+
+  // output[x] = input[x] > threshold(mean, stddev) ? background : object
+  // with the colors of kBinaryColors<UseBackgroundWhiteColor>, see
+  // ComputeBlockThresholds
+  template <bool UseBackgroundWhiteColor, class ThresholdFunction>
+  void BinarizeRowWithMeanStddev(const uint8_t* input,
+                                 uint8_t* output,
+                                 const LocalSumsRows<2>& local_sums_rows,
+                                 const size_t width,
+                                 const double area,
+                                 const ThresholdFunction& threshold) noexcept {
+    const auto& [sums, square_sums] = local_sums_rows;
+
+    std::array<double, kRowBlockSize> thresholds{};
+
+    for (size_t block = 0; block < width; block += kRowBlockSize) {
+      const auto block_size = std::min(kRowBlockSize, width - block);
+
+      ComputeBlockThresholds(sums + block,
+                             square_sums + block,
+                             block_size,
+                             area,
+                             threshold,
+                             thresholds.data());
+
+      // plain loop, left to the compiler auto-vectorizer: the colors are
+      // constants, the select folds into the comparison mask
+      constexpr auto kColors = kBinaryColors<UseBackgroundWhiteColor>;
+      for (size_t x = 0; x < block_size; ++x) {
+        output[block + x] = static_cast<double>(input[block + x]) >
+                                thresholds[x]
+                              ? kColors.background
+                              : kColors.object;
+      }
+    }
+#if CV_SIMD_64F
+    cv::vx_cleanup();
+#endif
+  }
+
+  // Same as BinarizeRowWithMeanStddev, with the output row packed as by
+  // PackBinaryRow: each block is decided into a buffer on the stack and
+  // packed right away, the 8-bit row is never written
+  template <bool UseBackgroundWhiteColor, class ThresholdFunction>
+  void BinarizePackedRowWithMeanStddev(
+    const uint8_t* input,
+    uint8_t* packed,
+    const LocalSumsRows<2>& local_sums_rows,
+    const size_t width,
+    const double area,
+    const ThresholdFunction& threshold) noexcept {
+    static_assert(kRowBlockSize % 8 == 0, "blocks are packed to whole bytes");
+
+    const auto& [sums, square_sums] = local_sums_rows;
+
+    std::array<double, kRowBlockSize> thresholds{};
+    std::array<uint8_t, kRowBlockSize> decisions{};
+
+    for (size_t block = 0; block < width; block += kRowBlockSize) {
+      const auto block_size = std::min(kRowBlockSize, width - block);
+
+      ComputeBlockThresholds(sums + block,
+                             square_sums + block,
+                             block_size,
+                             area,
+                             threshold,
+                             thresholds.data());
+
+      constexpr auto kColors = kBinaryColors<UseBackgroundWhiteColor>;
+      for (size_t x = 0; x < block_size; ++x) {
+        decisions[x] = static_cast<double>(input[block + x]) > thresholds[x]
+                         ? kColors.background
+                         : kColors.object;
+      }
+      PackBinaryRow(decisions.data(), block_size, packed + block / 8);
+    }
+#if CV_SIMD_64F
+    cv::vx_cleanup();
+#endif
+  }
+
+  // map[x] = ToThresholdMapValue<MapValue>(threshold(mean, stddev)), see
+  // ComputeBlockThresholds
+  template <class MapValue, class ThresholdFunction>
+  void ThresholdRowWithMeanStddev(const LocalSumsRows<2>& local_sums_rows,
+                                  MapValue* map,
+                                  const size_t width,
+                                  const double area,
+                                  const ThresholdFunction& threshold) noexcept {
+    const auto& [sums, square_sums] = local_sums_rows;
+
+    std::array<double, kRowBlockSize> thresholds{};
+
+    for (size_t block = 0; block < width; block += kRowBlockSize) {
+      const auto block_size = std::min(kRowBlockSize, width - block);
+
+      ComputeBlockThresholds(sums + block,
+                             square_sums + block,
+                             block_size,
+                             area,
+                             threshold,
+                             thresholds.data());
+
+      for (size_t x = 0; x < block_size; ++x) {
+        map[block + x] = ToThresholdMapValue<MapValue>(thresholds[x]);
+      }
+    }
+#if CV_SIMD_64F
+    cv::vx_cleanup();
+#endif
+  }
+
+}   // namespace longlp::imgproc::simd
+
+#endif   // IMGPROC_COMMON_SIMD_ROW_KERNELS_HPP_
@@ -0,0 +1,213 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/common/threshold_grid.hpp"
+
+#include <algorithm>   // std::min, std::max, std::copy_n
+#include <cstdint>
+
+namespace {
+  using longlp::imgproc::GetStripeCount;
+  using longlp::imgproc::GetStripeRows;
+  using longlp::imgproc::GrayscalePixel;
+  using longlp::imgproc::kGrayscaleMax;
+  using longlp::imgproc::kGrayscaleMin;
+  using longlp::imgproc::ThresholdGrid;
+  using longlp::imgproc::WorkspaceSlot;
+
+  using ErrorCode = cv::Error::Code;
+  using Window    = ThresholdGrid::Window;
+
+  // Number of blocks on each side of a block so that the window spans about
+  // |kernel_length| pixels, the whole kernel when |stride| is 1
+  auto GetWindowRadius(const int kernel_length, const int stride) noexcept
+    -> int {
+    return kernel_length / (2 * stride);
+  }
+
+  auto GetBlockCount(const int length, const int stride) noexcept -> int {
+    return (length + stride - 1) / stride;
+  }
+
+  void Merge(Window& window, const Window& other) noexcept {
+    window.count += other.count;
+    window.sum += other.sum;
+    window.square_sum += other.square_sum;
+    window.min = std::min(window.min, other.min);
+    window.max = std::max(window.max, other.max);
+  }
+}   // namespace
+
+ThresholdGrid::ThresholdGrid(const cv::Mat& input,
+                             const cv::Size& kernel_size,
+                             const int stride,
+                             const bool with_min_max,
+                             BinarizationWorkspace* workspace) :
+  input_{input},
+  workspace_{workspace},
+  stride_{stride},
+  window_radius_{GetWindowRadius(kernel_size.width, stride),
+                 GetWindowRadius(kernel_size.height, stride)} {
+  // pre-conditions
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if (input.type() != CV_8UC1 || input.dims != 2 || input.empty()) {
+    CV_Error(ErrorCode::StsBadArg,
+             "input must be non-empty 2D image, 8-bit, single channel");
+  }
+  if (kernel_size.empty()) {
+    CV_Error(ErrorCode::StsBadArg, "kernel size is empty");
+  }
+  if (stride < 1) {
+    CV_Error(ErrorCode::StsBadArg, "grid stride must be positive");
+  }
+
+  const cv::Size grid_size{GetBlockCount(input.cols, stride),
+                           GetBlockCount(input.rows, stride)};
+  const auto window_row_bytes =
+    static_cast<int>(static_cast<size_t>(grid_size.width) * sizeof(Window));
+
+  blocks_ = AcquireBuffer(workspace,
+                          WorkspaceSlot::kGridBlocks,
+                          cv::Size{window_row_bytes, grid_size.height},
+                          CV_8UC1);
+  windows_ = AcquireBuffer(workspace,
+                           WorkspaceSlot::kGridWindows,
+                           cv::Size{window_row_bytes, 2},
+                           CV_8UC1);
+  thresholds_ = AcquireBuffer(workspace,
+                              WorkspaceSlot::kGridThresholds,
+                              grid_size,
+                              CV_64FC1);
+
+  column_blocks_ = AcquireBuffer(workspace,
+                                 WorkspaceSlot::kColumnIndices,
+                                 cv::Size{input.cols, 1},
+                                 CV_32SC1);
+  column_weights_ = AcquireBuffer(workspace,
+                                  WorkspaceSlot::kGridColumnWeights,
+                                  cv::Size{input.cols, 1},
+                                  CV_64FC1);
+
+  auto* blocks  = column_blocks_.ptr<int>(0);
+  auto* weights = column_weights_.ptr<double>(0);
+  for (auto x = 0; x < input.cols; ++x) {
+    const auto [first, weight] = GetInterpolation(x, stride, grid_size.width);
+    blocks[x]                  = first;
+    weights[x]                 = weight;
+  }
+
+  MakeBlocks(with_min_max);
+}
+
+// static
+auto ThresholdGrid::GetInterpolation(const int position,
+                                     const int stride,
+                                     const int block_count) noexcept
+  -> Interpolation {
+  // in block centers
+  const auto location = (static_cast<double>(position) -
+                         static_cast<double>(stride - 1) / 2.0) /
+                        static_cast<double>(stride);
+  if (location <= 0.0) {
+    return {0, 0.0};
+  }
+
+  const auto first = cvFloor(location);
+  if (first >= block_count - 1) {
+    return {block_count - 1, 0.0};
+  }
+  return {first, location - static_cast<double>(first)};
+}
+
+void ThresholdGrid::MakeBlocks(const bool with_min_max) {
+  const auto stripe_count = GetStripeCount(blocks_.rows);
+
+  cv::parallel_for_(
+    cv::Range{0, stripe_count},
+    [this, &with_min_max, &stripe_count](const cv::Range& stripes) {
+      const auto grid_width = thresholds_.cols;
+
+      for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+        const auto block_rows =
+          GetStripeRows(stripe, stripe_count, blocks_.rows);
+
+        for (auto row = block_rows.start; row < block_rows.end; ++row) {
+          auto* blocks = blocks_.ptr<Window>(row);
+
+          const auto top    = row * stride_;
+          const auto bottom = std::min(input_.rows, top + stride_);
+          for (auto column = 0; column < grid_width; ++column) {
+            const auto left  = column * stride_;
+            const auto right = std::min(input_.cols, left + stride_);
+
+            // min and max start from the identity of std::min / std::max
+            blocks[column] =
+              Window{static_cast<double>((bottom - top) * (right - left)),
+                     0.0,
+                     0.0,
+                     kGrayscaleMax,
+                     kGrayscaleMin};
+          }
+
+          for (auto y = top; y < bottom; ++y) {
+            const auto* pixels = input_.ptr<GrayscalePixel>(y);
+
+            for (auto column = 0; column < grid_width; ++column) {
+              const auto left  = column * stride_;
+              const auto right = std::min(input_.cols, left + stride_);
+
+              uint64_t sum        = 0;
+              uint64_t square_sum = 0;
+              for (auto x = left; x < right; ++x) {
+                sum += pixels[x];
+                square_sum += static_cast<uint64_t>(pixels[x]) * pixels[x];
+              }
+              blocks[column].sum += static_cast<double>(sum);
+              blocks[column].square_sum += static_cast<double>(square_sum);
+
+              if (with_min_max) {
+                const auto [min, max] =
+                  std::minmax_element(pixels + left, pixels + right);
+                blocks[column].min = std::min(blocks[column].min, *min);
+                blocks[column].max = std::max(blocks[column].max, *max);
+              }
+            }
+          }
+        }
+      }
+    },
+    static_cast<double>(stripe_count));
+}
+
+auto ThresholdGrid::GetWindowsRow(const int row) -> const Window* {
+  const auto grid_width = static_cast<size_t>(thresholds_.cols);
+
+  auto* column_windows = windows_.ptr<Window>(0);
+  auto* row_windows    = windows_.ptr<Window>(1);
+
+  // blocks of the rows [first row, last row] merged per column
+  const auto first_row = std::max(0, row - window_radius_.height);
+  const auto last_row =
+    std::min(blocks_.rows - 1, row + window_radius_.height);
+  std::copy_n(blocks_.ptr<Window>(first_row), grid_width, column_windows);
+  for (auto block_row = first_row + 1; block_row <= last_row; ++block_row) {
+    const auto* blocks = blocks_.ptr<Window>(block_row);
+    for (size_t column = 0; column < grid_width; ++column) {
+      Merge(column_windows[column], blocks[column]);
+    }
+  }
+
+  // then merged across the columns [first column, last column]
+  const auto radius = static_cast<size_t>(window_radius_.width);
+  for (size_t column = 0; column < grid_width; ++column) {
+    const auto first_column = column > radius ? column - radius : 0;
+    const auto last_column  = std::min(grid_width - 1, column + radius);
+
+    row_windows[column] = column_windows[first_column];
+    for (auto other = first_column + 1; other <= last_column; ++other) {
+      Merge(row_windows[column], column_windows[other]);
+    }
+  }
+  return row_windows;
+}
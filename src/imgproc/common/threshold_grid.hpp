@@ -0,0 +1,170 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_THRESHOLD_GRID_HPP_
+#define IMGPROC_COMMON_THRESHOLD_GRID_HPP_
+
+#include <algorithm>   // std::max, std::min
+#include <cmath>       // std::sqrt
+#include <cstddef>
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/binarization_workspace.hpp"
+#include "imgproc/common/constant.hpp"
+#include "imgproc/common/local_sums.hpp"
+
+namespace longlp::imgproc {
+
+  // Approximate local thresholds, as in Sauvola's paper: the input is split
+  // into |stride| x |stride| blocks, a threshold is computed once per block
+  // from the statistics of a window of whole blocks around it, as close as
+  // possible to the kernel size, and the thresholds are bilinearly
+  // interpolated between the block centers. Windows are clipped to the image
+  // instead of reflected at its edges.
+  class ThresholdGrid {
+   public:
+    // Statistics of a window of pixels
+    struct Window {
+      double count;
+      double sum;
+      double square_sum;
+      GrayscalePixel min;
+      GrayscalePixel max;
+
+      [[nodiscard]] auto mean() const noexcept -> double {
+        return sum / count;
+      }
+
+      // same variance as simd::BinarizeRowWithMeanStddev, whose numerator is
+      // exact
+      [[nodiscard]] auto stddev() const noexcept -> double {
+        const auto variance =
+          (square_sum * count - sum * sum) / (count * count);
+        return std::sqrt(std::max(variance, 0.0));
+      }
+    };
+
+    // Window::min and Window::max are only computed |with_min_max|.
+    // Temporaries are taken from |workspace| when it is not null.
+    ThresholdGrid(const cv::Mat& input,
+                  const cv::Size& kernel_size,
+                  int stride,
+                  bool with_min_max,
+                  BinarizationWorkspace* workspace);
+
+    // threshold of every block = |threshold|(window of the block)
+    template <class WindowThreshold>
+    void ComputeThresholds(const WindowThreshold& threshold) {
+      for (auto row = 0; row < thresholds_.rows; ++row) {
+        const auto* windows = GetWindowsRow(row);
+        auto* thresholds    = thresholds_.ptr<double>(row);
+        for (auto column = 0; column < thresholds_.cols; ++column) {
+          thresholds[column] = threshold(windows[column]);
+        }
+      }
+    }
+
+    // output[x] = input[x] > interpolated threshold ? background : object
+    // with the colors of kBinaryColors<UseBackgroundWhiteColor>
+    template <bool UseBackgroundWhiteColor>
+    void Binarize(cv::Mat& output) const;
+
+   private:
+    // Position between the centers of the blocks |first| and |first| + 1
+    struct Interpolation {
+      int first;
+      double weight;
+    };
+
+    static auto GetInterpolation(int position,
+                                 int stride,
+                                 int block_count) noexcept -> Interpolation;
+
+    void MakeBlocks(bool with_min_max);
+
+    // Windows of the blocks of the grid row |row|, valid until the next call
+    auto GetWindowsRow(int row) -> const Window*;
+
+    cv::Mat input_;
+    BinarizationWorkspace* workspace_;
+    int stride_;
+
+    // in blocks
+    cv::Size window_radius_;
+
+    // Window of every block, then a row of column windows and a row of
+    // windows as scratch of GetWindowsRow
+    cv::Mat blocks_;
+    cv::Mat windows_;
+
+    // CV_64FC1, one per block
+    cv::Mat thresholds_;
+
+    // first block and weight of the horizontal interpolation of each column
+    cv::Mat column_blocks_;
+    cv::Mat column_weights_;
+  };
+
+  template <bool UseBackgroundWhiteColor>
+  void ThresholdGrid::Binarize(cv::Mat& output) const {
+    output.create(input_.size(), CV_8UC1);
+
+    // one row of interpolated thresholds per stripe, plus a copy of its last
+    // one so that the horizontal interpolation never reads past the row
+    const auto stripe_count = GetStripeCount(input_.rows);
+    auto stripe_buffers =
+      AcquireBuffer(workspace_,
+                    WorkspaceSlot::kStripeBuffers,
+                    cv::Size{thresholds_.cols + 1, stripe_count},
+                    CV_64FC1);
+
+    cv::parallel_for_(
+      cv::Range{0, stripe_count},
+      [this, &output, &stripe_buffers, &stripe_count](
+        const cv::Range& stripes) {
+        constexpr auto kColors = kBinaryColors<UseBackgroundWhiteColor>;
+
+        const auto* blocks  = column_blocks_.ptr<int>(0);
+        const auto* weights = column_weights_.ptr<double>(0);
+
+        const auto grid_width = static_cast<size_t>(thresholds_.cols);
+        const auto width      = static_cast<size_t>(input_.cols);
+
+        for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+          auto* row_thresholds = stripe_buffers.ptr<double>(stripe);
+
+          const auto rows = GetStripeRows(stripe, stripe_count, input_.rows);
+          for (auto y = rows.start; y < rows.end; ++y) {
+            const auto [first, weight] =
+              GetInterpolation(y, stride_, thresholds_.rows);
+            const auto* top    = thresholds_.ptr<double>(first);
+            const auto* bottom = thresholds_.ptr<double>(
+              std::min(first + 1, thresholds_.rows - 1));
+
+            for (size_t i = 0; i < grid_width; ++i) {
+              row_thresholds[i] = top[i] + weight * (bottom[i] - top[i]);
+            }
+            row_thresholds[grid_width] = row_thresholds[grid_width - 1];
+
+            const auto* pixels = input_.ptr<GrayscalePixel>(y);
+            auto* binarized    = output.ptr<GrayscalePixel>(y);
+            for (size_t x = 0; x < width; ++x) {
+              const auto* left = row_thresholds + blocks[x];
+              const auto threshold =
+                left[0] + weights[x] * (left[1] - left[0]);
+
+              binarized[x] = static_cast<double>(pixels[x]) > threshold
+                               ? kColors.background
+                               : kColors.object;
+            }
+          }
+        }
+      },
+      static_cast<double>(stripe_count));
+  }
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_THRESHOLD_GRID_HPP_
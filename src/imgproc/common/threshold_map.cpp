@@ -0,0 +1,154 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/common/threshold_map.hpp"
+
+#include <cstddef>
+
+#include <opencv2/core/hal/intrin.hpp>
+
+#include "imgproc/common/local_sums.hpp"
+
+namespace {
+  using longlp::imgproc::GetStripeCount;
+  using longlp::imgproc::GetStripeRows;
+  using longlp::imgproc::GrayscalePixel;
+  using longlp::imgproc::kBinaryColors;
+
+  using ErrorCode = cv::Error::Code;
+
+#if CV_SIMD
+  // all bits set in the lanes where pixel > threshold
+  auto IsGreater(const GrayscalePixel* input, const float* map) noexcept
+    -> cv::v_uint32 {
+    const auto pixels =
+      cv::v_cvt_f32(cv::v_reinterpret_as_s32(cv::vx_load_expand_q(input)));
+    return cv::v_reinterpret_as_u32(cv::v_gt(pixels, cv::vx_load(map)));
+  }
+
+  // background lanes of |is_background| to colors
+  template <bool UseBackgroundWhiteColor>
+  auto ToColors(const cv::v_uint8& is_background) noexcept -> cv::v_uint8 {
+    if constexpr (UseBackgroundWhiteColor) {
+      return is_background;
+    }
+    else {
+      return cv::v_not(is_background);
+    }
+  }
+#endif
+
+  // output[x] = input[x] > map[x] ? background : object
+  template <bool UseBackgroundWhiteColor>
+  void ApplyRow(const GrayscalePixel* input,
+                const GrayscalePixel* map,
+                GrayscalePixel* output,
+                const size_t width) noexcept {
+    size_t x = 0;
+#if CV_SIMD
+    const auto lanes = static_cast<size_t>(cv::VTraits<cv::v_uint8>::vlanes());
+    for (; x + lanes <= width; x += lanes) {
+      const auto is_background =
+        cv::v_gt(cv::vx_load(input + x), cv::vx_load(map + x));
+      cv::v_store(output + x, ToColors<UseBackgroundWhiteColor>(is_background));
+    }
+#endif
+    constexpr auto kColors = kBinaryColors<UseBackgroundWhiteColor>;
+    for (; x < width; ++x) {
+      output[x] = input[x] > map[x] ? kColors.background : kColors.object;
+    }
+  }
+
+  template <bool UseBackgroundWhiteColor>
+  void ApplyRow(const GrayscalePixel* input,
+                const float* map,
+                GrayscalePixel* output,
+                const size_t width) noexcept {
+    size_t x = 0;
+#if CV_SIMD
+    // four float vectors per 8-bit vector
+    const auto lanes = static_cast<size_t>(cv::VTraits<cv::v_uint8>::vlanes());
+    const auto quarter = lanes / 4;
+    for (; x + lanes <= width; x += lanes) {
+      const auto is_background =
+        cv::v_pack_b(IsGreater(input + x, map + x),
+                     IsGreater(input + x + quarter, map + x + quarter),
+                     IsGreater(input + x + 2 * quarter, map + x + 2 * quarter),
+                     IsGreater(input + x + 3 * quarter, map + x + 3 * quarter));
+      cv::v_store(output + x, ToColors<UseBackgroundWhiteColor>(is_background));
+    }
+#endif
+    constexpr auto kColors = kBinaryColors<UseBackgroundWhiteColor>;
+    for (; x < width; ++x) {
+      output[x] = static_cast<float>(input[x]) > map[x] ? kColors.background
+                                                        : kColors.object;
+    }
+  }
+
+  template <bool UseBackgroundWhiteColor, class MapValue>
+  void ApplyRows(const cv::Mat& input, const cv::Mat& map, cv::Mat& output) {
+    const auto stripe_count = GetStripeCount(input.rows);
+
+    cv::parallel_for_(
+      cv::Range{0, stripe_count},
+      [&input, &map, &output, &stripe_count](const cv::Range& stripes) {
+        const auto width = static_cast<size_t>(input.cols);
+
+        for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+          const auto rows = GetStripeRows(stripe, stripe_count, input.rows);
+          for (auto y = rows.start; y < rows.end; ++y) {
+            ApplyRow<UseBackgroundWhiteColor>(input.ptr<GrayscalePixel>(y),
+                                              map.ptr<MapValue>(y),
+                                              output.ptr<GrayscalePixel>(y),
+                                              width);
+          }
+        }
+#if CV_SIMD
+        cv::vx_cleanup();
+#endif
+      },
+      static_cast<double>(stripe_count));
+  }
+}   // namespace
+
+void longlp::imgproc::ApplyThresholdMap(const cv::Mat& input,
+                                        const cv::Mat& map,
+                                        cv::Mat& output,
+                                        const bool use_background_white_color) {
+  // pre-conditions
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if (input.type() != CV_8UC1 || input.dims != 2) {
+    CV_Error(ErrorCode::StsBadArg,
+             "input must be 2D image, 8-bit, single channel");
+  }
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if ((map.type() != CV_8UC1 && map.type() != CV_32FC1) || map.dims != 2 ||
+      map.size() != input.size()) {
+    CV_Error(ErrorCode::StsBadArg,
+             "map must be 2D image, 8-bit or 32-bit float, single channel "
+             "with the same size as input");
+  }
+
+  // |output| may be |input| or |map|, keep a reference on their data in case
+  // it is reallocated. Each pixel is read before being written.
+  const cv::Mat source     = input;
+  const cv::Mat thresholds = map;
+  output.create(source.size(), CV_8UC1);
+
+  DispatchPolarity(
+    use_background_white_color,
+    [&source, &thresholds, &output](auto use_background_white) {
+      constexpr auto kUseBackgroundWhite =
+        decltype(use_background_white)::value;
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      if (thresholds.type() == CV_8UC1) {
+        ApplyRows<kUseBackgroundWhite, GrayscalePixel>(source,
+                                                       thresholds,
+                                                       output);
+      }
+      else {
+        ApplyRows<kUseBackgroundWhite, float>(source, thresholds, output);
+      }
+    });
+}
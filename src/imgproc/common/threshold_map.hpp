@@ -0,0 +1,63 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_COMMON_THRESHOLD_MAP_HPP_
+#define IMGPROC_COMMON_THRESHOLD_MAP_HPP_
+
+#include <cmath>        // std::floor, std::nextafter
+#include <functional>   // std::invoke
+#include <limits>
+#include <type_traits>
+#include <utility>      // std::forward
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/constant.hpp"
+
+namespace longlp::imgproc {
+
+  // A threshold map holds the local threshold of every pixel of an image:
+  // the pixel is background when it is greater than its threshold, object
+  // otherwise, see ApplyThresholdMap. Maps are either
+  // - CV_32FC1: thresholds rounded down to float, which gives the same
+  //   decisions as the double thresholds for 8-bit pixels
+  // - CV_8UC1: thresholds rounded down and clamped to [0, 255], the same
+  //   decisions except for 0 pixels under a negative threshold
+  template <class MapValue>
+  requires std::is_same_v<MapValue, float> ||
+           std::is_same_v<MapValue, GrayscalePixel>
+  auto ToThresholdMapValue(const double threshold) noexcept -> MapValue {
+    if constexpr (std::is_same_v<MapValue, float>) {
+      const auto value = static_cast<float>(threshold);
+      return static_cast<double>(value) > threshold
+               ? std::nextafter(value, -std::numeric_limits<float>::infinity())
+               : value;
+    }
+    else {
+      return cv::saturate_cast<GrayscalePixel>(std::floor(threshold));
+    }
+  }
+
+  // Calls |function| with a value of the element type of |map_type|, either
+  // CV_8UC1 or CV_32FC1
+  template <class Function>
+  decltype(auto) DispatchMapType(const int map_type, Function&& function) {
+    // NOLINTNEXTLINE(hicpp-signed-bitwise)
+    if (map_type == CV_8UC1) {
+      return std::invoke(std::forward<Function>(function), GrayscalePixel{});
+    }
+    return std::invoke(std::forward<Function>(function), float{});
+  }
+
+  // output = input > map ? background : object, |input| is an 8-bit, single
+  // channel image and |map| a threshold map of the same size. |output| is
+  // created with the size of |input|, it may be |input| itself.
+  void ApplyThresholdMap(const cv::Mat& input,
+                         const cv::Mat& map,
+                         cv::Mat& output,
+                         bool use_background_white_color);
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_COMMON_THRESHOLD_MAP_HPP_
@@ -0,0 +1,325 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/evaluation/binarization_evaluator.hpp"
+
+#include <algorithm>   // std::min, std::max
+#include <bit>         // std::popcount, std::countr_zero
+#include <cmath>       // std::sqrt, std::log10
+#include <limits>
+#include <vector>   // stripe counts
+
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/ximgproc.hpp>
+
+#include "imgproc/common/local_sums.hpp"
+
+namespace {
+  using longlp::imgproc::BinarizationEvaluator;
+  using longlp::imgproc::BinarizationScores;
+  using longlp::imgproc::GetStripeCount;
+  using longlp::imgproc::GetStripeRows;
+  using longlp::imgproc::PackedBinaryImage;
+
+  using ErrorCode = cv::Error::Code;
+
+  constexpr auto kWordBits = PackedBinaryImage::kWordBits;
+
+  // 5x5 window of the DRD
+  constexpr auto kDrdWindowSize = 5;
+  constexpr auto kDrdRadius     = kDrdWindowSize / 2;
+  constexpr auto kDrdPatterns   = size_t{1} << kDrdWindowSize;
+
+  // blocks of the count of non-uniform blocks of the DRD
+  constexpr auto kDrdBlockSize = 8;
+
+  // Pixel counts of a stripe of rows, bits are object pixels
+  struct Counts {
+    // output & ground truth
+    uint64_t true_positives;
+    // output & ~ground truth
+    uint64_t false_positives;
+    // ~output & ground truth
+    uint64_t false_negatives;
+    // output & skeleton
+    uint64_t skeleton_hits;
+    double distortion;
+  };
+
+  void CountRow(const uint64_t* output,
+                const uint64_t* ground_truth,
+                const uint64_t* skeleton,
+                const size_t words,
+                Counts& counts) noexcept {
+    size_t i = 0;
+#if CV_SIMD
+    const auto lanes =
+      static_cast<size_t>(cv::VTraits<cv::v_uint64>::vlanes());
+    auto true_positives  = cv::vx_setzero_u64();
+    auto false_positives = cv::vx_setzero_u64();
+    auto false_negatives = cv::vx_setzero_u64();
+    auto skeleton_hits   = cv::vx_setzero_u64();
+
+    for (; i + lanes <= words; i += lanes) {
+      const auto out   = cv::vx_load(output + i);
+      const auto truth = cv::vx_load(ground_truth + i);
+
+      true_positives =
+        cv::v_add(true_positives, cv::v_popcount(cv::v_and(out, truth)));
+      false_positives =
+        cv::v_add(false_positives,
+                  cv::v_popcount(cv::v_and(out, cv::v_not(truth))));
+      false_negatives =
+        cv::v_add(false_negatives,
+                  cv::v_popcount(cv::v_and(cv::v_not(out), truth)));
+      skeleton_hits = cv::v_add(
+        skeleton_hits,
+        cv::v_popcount(cv::v_and(out, cv::vx_load(skeleton + i))));
+    }
+    counts.true_positives += cv::v_reduce_sum(true_positives);
+    counts.false_positives += cv::v_reduce_sum(false_positives);
+    counts.false_negatives += cv::v_reduce_sum(false_negatives);
+    counts.skeleton_hits += cv::v_reduce_sum(skeleton_hits);
+#endif
+    for (; i < words; ++i) {
+      counts.true_positives +=
+        static_cast<uint64_t>(std::popcount(output[i] & ground_truth[i]));
+      counts.false_positives +=
+        static_cast<uint64_t>(std::popcount(output[i] & ~ground_truth[i]));
+      counts.false_negatives +=
+        static_cast<uint64_t>(std::popcount(~output[i] & ground_truth[i]));
+      counts.skeleton_hits +=
+        static_cast<uint64_t>(std::popcount(output[i] & skeleton[i]));
+    }
+  }
+
+  auto CountBits(const PackedBinaryImage& image) noexcept -> uint64_t {
+    uint64_t count = 0;
+    for (auto y = 0; y < image.size().height; ++y) {
+      const auto* words = image.row(y);
+      for (size_t i = 0; i < image.words_per_row(); ++i) {
+        count += static_cast<uint64_t>(std::popcount(words[i]));
+      }
+    }
+    return count;
+  }
+
+  // Number of the 8x8 blocks of |image|, clipped to it, holding both black
+  // and white pixels: a block spans one byte of 8 rows
+  auto CountNonUniformBlocks(const PackedBinaryImage& image) noexcept
+    -> uint64_t {
+    const auto [width, height] = image.size();
+
+    uint64_t count = 0;
+    for (auto top = 0; top < height; top += kDrdBlockSize) {
+      const auto bottom = std::min(height, top + kDrdBlockSize);
+
+      for (size_t byte = 0; byte < image.bytes_per_row(); ++byte) {
+        const auto columns = std::min(size_t{kDrdBlockSize},
+                                      static_cast<size_t>(width) - byte * 8);
+        const auto valid = static_cast<uint8_t>(0xFF00U >> columns);
+
+        auto any = uint8_t{0};
+        auto all = valid;
+        for (auto y = top; y < bottom; ++y) {
+          any |= image.bytes(y)[byte];
+          all &= image.bytes(y)[byte];
+        }
+        count += any != 0 && all != valid ? 1 : 0;
+      }
+    }
+    return count;
+  }
+
+  // Column of the bit |bit| of the word |word| of a packed row: the words
+  // are little-endian, the bytes MSB-first
+  auto GetColumn(const size_t word, const size_t bit) noexcept -> int {
+    return static_cast<int>(word * kWordBits + (bit & ~size_t{7}) +
+                            (7 - bit % 8));
+  }
+
+  // weights[row][pattern] as in BinarizationEvaluator::drd_weights_: the
+  // weight of a pixel of the window is the inverse of its distance to the
+  // center, 0 for the center, normalized to a sum of 1
+  auto MakeDrdWeights()
+    -> std::array<std::array<double, kDrdPatterns>, kDrdWindowSize> {
+    std::array<std::array<double, kDrdWindowSize>, kDrdWindowSize> pixels{};
+    auto sum = 0.0;
+    for (auto row = 0; row < kDrdWindowSize; ++row) {
+      for (auto column = 0; column < kDrdWindowSize; ++column) {
+        const auto dy = static_cast<double>(row - kDrdRadius);
+        const auto dx = static_cast<double>(column - kDrdRadius);
+        const auto weight =
+          row == kDrdRadius && column == kDrdRadius
+            ? 0.0
+            : 1.0 / std::sqrt(dx * dx + dy * dy);
+
+        pixels[static_cast<size_t>(row)][static_cast<size_t>(column)] = weight;
+        sum += weight;
+      }
+    }
+
+    std::array<std::array<double, kDrdPatterns>, kDrdWindowSize> weights{};
+    for (size_t row = 0; row < kDrdWindowSize; ++row) {
+      for (size_t pattern = 0; pattern < kDrdPatterns; ++pattern) {
+        for (size_t column = 0; column < kDrdWindowSize; ++column) {
+          if ((pattern >> column & 1U) != 0) {
+            weights[row][pattern] += pixels[row][column] / sum;
+          }
+        }
+      }
+    }
+    return weights;
+  }
+
+  auto Ratio(const double numerator, const double denominator) noexcept
+    -> double {
+    return denominator > 0.0 ? numerator / denominator : 0.0;
+  }
+
+  auto GetFMeasure(const double precision, const double recall) noexcept
+    -> double {
+    return Ratio(2.0 * precision * recall, precision + recall);
+  }
+}   // namespace
+
+BinarizationEvaluator::BinarizationEvaluator(const cv::Mat& ground_truth) :
+  drd_weights_{MakeDrdWeights()} {
+  // pre-conditions
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  if (ground_truth.type() != CV_8UC1 || ground_truth.dims != 2 ||
+      ground_truth.empty()) {
+    CV_Error(ErrorCode::StsBadArg,
+             "ground truth must be non-empty 2D image, 8-bit, single channel");
+  }
+
+  ground_truth_.Pack(ground_truth);
+  non_uniform_blocks_ = CountNonUniformBlocks(ground_truth_);
+
+  // thinning takes the object pixels as non-zero, its skeleton pixels are
+  // packed as object pixels
+  cv::Mat objects;
+  cv::compare(ground_truth, 0, objects, cv::CmpTypes::CMP_EQ);
+  cv::Mat skeleton;
+  cv::ximgproc::thinning(objects,
+                         skeleton,
+                         cv::ximgproc::ThinningTypes::THINNING_ZHANGSUEN);
+  cv::compare(skeleton, 0, skeleton, cv::CmpTypes::CMP_EQ);
+  skeleton_.Pack(skeleton);
+  skeleton_pixels_ = CountBits(skeleton_);
+}
+
+auto BinarizationEvaluator::Evaluate(const cv::Mat& output) const
+  -> BinarizationScores {
+  return Evaluate(PackedBinaryImage{output});
+}
+
+auto BinarizationEvaluator::Evaluate(const PackedBinaryImage& output) const
+  -> BinarizationScores {
+  // pre-conditions
+  if (output.size() != ground_truth_.size()) {
+    CV_Error(ErrorCode::StsBadArg,
+             "output does not have the size of the ground truth");
+  }
+
+  const auto rows         = ground_truth_.size().height;
+  const auto stripe_count = GetStripeCount(rows);
+  std::vector<Counts> stripe_counts(static_cast<size_t>(stripe_count));
+
+  cv::parallel_for_(
+    cv::Range{0, stripe_count},
+    [this, &output, &rows, &stripe_count, &stripe_counts](
+      const cv::Range& stripes) {
+      const auto words = ground_truth_.words_per_row();
+
+      for (auto stripe = stripes.start; stripe < stripes.end; ++stripe) {
+        auto& counts = stripe_counts[static_cast<size_t>(stripe)];
+
+        const auto stripe_rows = GetStripeRows(stripe, stripe_count, rows);
+        for (auto y = stripe_rows.start; y < stripe_rows.end; ++y) {
+          const auto* out   = output.row(y);
+          const auto* truth = ground_truth_.row(y);
+          CountRow(out, truth, skeleton_.row(y), words, counts);
+
+          // flipped pixels, one set bit at a time
+          for (size_t i = 0; i < words; ++i) {
+            for (auto flipped = out[i] ^ truth[i]; flipped != 0;
+                 flipped &= flipped - 1) {
+              const auto bit = static_cast<size_t>(std::countr_zero(flipped));
+              counts.distortion += GetDistortion(GetColumn(i, bit),
+                                                 y,
+                                                 (out[i] >> bit & 1U) != 0);
+            }
+          }
+        }
+      }
+#if CV_SIMD
+      cv::vx_cleanup();
+#endif
+    },
+    static_cast<double>(stripe_count));
+
+  Counts total{};
+  for (const auto& counts : stripe_counts) {
+    total.true_positives += counts.true_positives;
+    total.false_positives += counts.false_positives;
+    total.false_negatives += counts.false_negatives;
+    total.skeleton_hits += counts.skeleton_hits;
+    total.distortion += counts.distortion;
+  }
+
+  const auto true_positives = static_cast<double>(total.true_positives);
+  const auto precision =
+    Ratio(true_positives,
+          true_positives + static_cast<double>(total.false_positives));
+  const auto recall =
+    Ratio(true_positives,
+          true_positives + static_cast<double>(total.false_negatives));
+  const auto pseudo_recall = Ratio(static_cast<double>(total.skeleton_hits),
+                                   static_cast<double>(skeleton_pixels_));
+
+  // the difference between object and background is 1
+  const auto flipped_pixels =
+    static_cast<double>(total.false_positives + total.false_negatives);
+  const auto pixels = static_cast<double>(ground_truth_.size().area());
+
+  return {
+    GetFMeasure(precision, recall),
+    GetFMeasure(precision, pseudo_recall),
+    flipped_pixels > 0.0 ? 10.0 * std::log10(pixels / flipped_pixels)
+                         : std::numeric_limits<double>::infinity(),
+    total.distortion /
+      static_cast<double>(std::max(non_uniform_blocks_, uint64_t{1}))};
+}
+
+auto BinarizationEvaluator::GetDistortion(const int x,
+                                          const int y,
+                                          const bool is_object) const
+  -> double {
+  const auto [width, height] = ground_truth_.size();
+
+  auto distortion = 0.0;
+  for (auto row = 0; row < kDrdWindowSize; ++row) {
+    // the ground truth is background outside the image
+    size_t pattern = 0;
+    if (const auto window_y = y + row - kDrdRadius;
+        window_y >= 0 && window_y < height) {
+      const auto* bytes = ground_truth_.bytes(window_y);
+      for (auto column = 0; column < kDrdWindowSize; ++column) {
+        if (const auto window_x = x + column - kDrdRadius;
+            window_x >= 0 && window_x < width) {
+          const auto position = static_cast<size_t>(window_x);
+          pattern |= (bytes[position / 8] >> (7 - position % 8) & 1U)
+                     << column;
+        }
+      }
+    }
+
+    // weights of the ground truth pixels differing from the output pixel
+    const auto& weights = drd_weights_[static_cast<size_t>(row)];
+    distortion += is_object ? weights[kDrdPatterns - 1] - weights[pattern]
+                            : weights[pattern];
+  }
+  return distortion;
+}
@@ -0,0 +1,71 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_EVALUATION_BINARIZATION_EVALUATOR_HPP_
+#define IMGPROC_EVALUATION_BINARIZATION_EVALUATOR_HPP_
+
+#include <array>   // DRD weights
+#include <cstddef>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/packed_binary_image.hpp"
+
+namespace longlp::imgproc {
+
+  // Measures of a binarized image against its ground truth, as in the DIBCO
+  // contests. Object (text) pixels are 0 in both images.
+  struct BinarizationScores {
+    // harmonic mean of the precision and the recall of the object pixels,
+    // in [0, 1]
+    double f_measure;
+
+    // same, with the recall measured on the skeleton of the ground truth
+    double pseudo_f_measure;
+
+    // peak signal to noise ratio in dB, infinite when the images are equal
+    double psnr;
+
+    // distance reciprocal distortion of the flipped pixels, per non-uniform
+    // 8x8 block of the ground truth
+    double drd;
+  };
+
+  // Scores many outputs against one ground truth: the ground truth and its
+  // skeleton are packed once, each output is packed to one bit per pixel,
+  // then counted a word at a time with popcount over stripes of rows in
+  // parallel. Only the flipped pixels are visited for the DRD.
+  class BinarizationEvaluator {
+   public:
+    // |ground_truth| is a non-empty 2D, 8-bit, single channel image
+    explicit BinarizationEvaluator(const cv::Mat& ground_truth);
+
+    // |output| has the size of the ground truth
+    [[nodiscard]] auto Evaluate(const cv::Mat& output) const
+      -> BinarizationScores;
+
+    // Same as above, for an output already packed
+    [[nodiscard]] auto Evaluate(const PackedBinaryImage& output) const
+      -> BinarizationScores;
+
+   private:
+    // DRD of the flipped pixel (|x|, |y|) of the output, object or not
+    [[nodiscard]] auto GetDistortion(int x, int y, bool is_object) const
+      -> double;
+
+    PackedBinaryImage ground_truth_;
+    PackedBinaryImage skeleton_;
+    uint64_t skeleton_pixels_{};
+    uint64_t non_uniform_blocks_{};
+
+    // drd_weights_[row][pattern] is the sum of the normalized weights of the
+    // row |row| of the 5x5 DRD window over the set bits of the 5-bit
+    // |pattern|, one bit per column
+    std::array<std::array<double, 32>, 5> drd_weights_{};
+  };
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_EVALUATION_BINARIZATION_EVALUATOR_HPP_
@@ -6,5 +6,9 @@
 #define IMGPROC_IMGPROC_HPP_
 
 #include "imgproc/binarization/binarization.hpp"
+#include "imgproc/evaluation/binarization_evaluator.hpp"
+#include "imgproc/io/mapped_image.hpp"
+#include "imgproc/io/pbm_writer.hpp"
+#include "imgproc/io/tiff_g4_writer.hpp"
 
 #endif   // IMGPROC_IMGPROC_HPP_
@@ -0,0 +1,220 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/io/mapped_file.hpp"
+
+#include <utility>   // std::exchange
+
+#include <fmt/format.h>
+#include <opencv2/core.hpp>
+
+#if defined(_WIN32)
+  #define NOMINMAX
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace {
+  using longlp::imgproc::MappedFile;
+
+  using ErrorCode = cv::Error::Code;
+
+  [[noreturn]] void RaiseMapError(const std::string& path,
+                                  const char* operation) {
+    CV_Error(ErrorCode::StsError,
+             fmt::format("cannot {} the file {}", operation, path));
+  }
+
+#if defined(_WIN32)
+  // Closes a handle on scope exit, the view keeps its mapping alive
+  struct HandleCloser {
+    HANDLE handle;
+
+    ~HandleCloser() {
+      if (handle != nullptr && handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+      }
+    }
+  };
+
+  auto QueryFileSize(const std::string& path) -> size_t {
+    WIN32_FILE_ATTRIBUTE_DATA attributes{};
+    if (GetFileAttributesExA(path.c_str(),
+                             GetFileExInfoStandard,
+                             &attributes) == 0) {
+      RaiseMapError(path, "open");
+    }
+    return static_cast<size_t>(
+      static_cast<uint64_t>(attributes.nFileSizeHigh) << 32U |
+      attributes.nFileSizeLow);
+  }
+
+  auto Map(const std::string& path, size_t& size, const bool writable)
+    -> uint8_t* {
+    if (!writable) {
+      size = QueryFileSize(path);
+    }
+    if (size == 0) {
+      CV_Error(ErrorCode::StsBadArg, fmt::format("{} is empty", path));
+    }
+
+    const HandleCloser file{
+      CreateFileA(path.c_str(),
+                  writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                  FILE_SHARE_READ,
+                  nullptr,
+                  writable ? CREATE_ALWAYS : OPEN_EXISTING,
+                  FILE_FLAG_SEQUENTIAL_SCAN,
+                  nullptr)};
+    if (file.handle == INVALID_HANDLE_VALUE) {
+      RaiseMapError(path, "open");
+    }
+
+    const auto size_bits = static_cast<uint64_t>(size);
+    const HandleCloser mapping{
+      CreateFileMappingA(file.handle,
+                         nullptr,
+                         writable ? PAGE_READWRITE : PAGE_READONLY,
+                         static_cast<DWORD>(size_bits >> 32U),
+                         static_cast<DWORD>(size_bits),
+                         nullptr)};
+    if (mapping.handle == nullptr) {
+      RaiseMapError(path, "map");
+    }
+
+    auto* view = MapViewOfFile(mapping.handle,
+                               writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                               0,
+                               0,
+                               size);
+    if (view == nullptr) {
+      RaiseMapError(path, "map");
+    }
+    return static_cast<uint8_t*>(view);
+  }
+#else
+  // Closes a file descriptor on scope exit, the mapping stays valid
+  struct DescriptorCloser {
+    int descriptor;
+
+    ~DescriptorCloser() {
+      if (descriptor >= 0) {
+        close(descriptor);
+      }
+    }
+  };
+
+  auto Map(const std::string& path, size_t& size, const bool writable)
+    -> uint8_t* {
+    // NOLINTNEXTLINE(hicpp-signed-bitwise)
+    const DescriptorCloser file{writable
+                                  ? open(path.c_str(),
+                                         O_RDWR | O_CREAT | O_TRUNC,
+                                         0644)
+                                  : open(path.c_str(), O_RDONLY)};
+    if (file.descriptor < 0) {
+      RaiseMapError(path, "open");
+    }
+
+    if (writable) {
+      if (ftruncate(file.descriptor, static_cast<off_t>(size)) != 0) {
+        RaiseMapError(path, "resize");
+      }
+    }
+    else {
+      struct stat status {};
+      if (fstat(file.descriptor, &status) != 0) {
+        RaiseMapError(path, "open");
+      }
+      size = static_cast<size_t>(status.st_size);
+    }
+    if (size == 0) {
+      CV_Error(ErrorCode::StsBadArg, fmt::format("{} is empty", path));
+    }
+
+    auto* data = mmap(nullptr,
+                      size,
+                      writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      writable ? MAP_SHARED : MAP_PRIVATE,
+                      file.descriptor,
+                      0);
+    if (data == MAP_FAILED) {
+      RaiseMapError(path, "map");
+    }
+    return static_cast<uint8_t*>(data);
+  }
+#endif
+}   // namespace
+
+MappedFile::MappedFile(const std::string& path) {
+  data_ = Map(path, size_, false);
+}
+
+MappedFile::MappedFile(const std::string& path, const size_t size) :
+  size_{size} {
+  // pre-conditions
+  if (size == 0) {
+    CV_Error(ErrorCode::StsBadArg, "mapped size must be positive");
+  }
+
+  data_ = Map(path, size_, true);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+  data_{std::exchange(other.data_, nullptr)},
+  size_{std::exchange(other.size_, 0)} {}
+
+auto MappedFile::operator=(MappedFile&& other) noexcept -> MappedFile& {
+  if (this != &other) {
+    Unmap();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  Unmap();
+}
+
+void MappedFile::AdviseSequential() const noexcept {
+#if !defined(_WIN32)
+  // a hint only, the mapping is still correct when it is not applied
+  if (data_ != nullptr) {
+    madvise(data_, size_, MADV_SEQUENTIAL);
+  }
+#endif
+}
+
+void MappedFile::Flush() const {
+  if (data_ == nullptr) {
+    return;
+  }
+#if defined(_WIN32)
+  const auto flushed = FlushViewOfFile(data_, size_) != 0;
+#else
+  const auto flushed = msync(data_, size_, MS_SYNC) == 0;
+#endif
+  if (!flushed) {
+    CV_Error(ErrorCode::StsError, "cannot write the mapped file back");
+  }
+}
+
+void MappedFile::Unmap() noexcept {
+  if (data_ == nullptr) {
+    return;
+  }
+#if defined(_WIN32)
+  UnmapViewOfFile(data_);
+#else
+  munmap(data_, size_);
+#endif
+  data_ = nullptr;
+  size_ = 0;
+}
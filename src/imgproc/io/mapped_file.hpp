@@ -0,0 +1,61 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_IO_MAPPED_FILE_HPP_
+#define IMGPROC_IO_MAPPED_FILE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace longlp::imgproc {
+
+  // Whole file mapped in memory, unmapped on destruction. Pages are read
+  // from, and written back to, the page cache by the kernel without any
+  // copy into user buffers.
+  class MappedFile {
+   public:
+    MappedFile() = default;
+
+    // Maps the existing, non-empty file |path| read-only
+    explicit MappedFile(const std::string& path);
+
+    // Creates |path|, or truncates it, to |size| bytes mapped for reading
+    // and writing
+    MappedFile(const std::string& path, size_t size);
+
+    MappedFile(const MappedFile&)                    = delete;
+    auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    auto operator=(MappedFile&& other) noexcept -> MappedFile&;
+
+    ~MappedFile();
+
+    // Written only when mapped for writing
+    [[nodiscard]] auto data() const noexcept -> uint8_t* {
+      return data_;
+    }
+
+    [[nodiscard]] auto size() const noexcept -> size_t {
+      return size_;
+    }
+
+    // Hints the kernel that the mapping is accessed once from start to end,
+    // so that it reads ahead aggressively and drops the pages behind
+    void AdviseSequential() const noexcept;
+
+    // Writes the modified pages back to the file before returning
+    void Flush() const;
+
+   private:
+    void Unmap() noexcept;
+
+    uint8_t* data_{nullptr};
+    size_t size_{0};
+  };
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_IO_MAPPED_FILE_HPP_
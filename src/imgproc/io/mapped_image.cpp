@@ -0,0 +1,156 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/io/mapped_image.hpp"
+
+#include <algorithm>   // std::copy
+
+#include <fmt/format.h>
+
+namespace {
+  using longlp::imgproc::MappedFile;
+  using longlp::imgproc::MappedImageFormat;
+  using longlp::imgproc::MappedImageReader;
+  using longlp::imgproc::MappedImageWriter;
+
+  using ErrorCode = cv::Error::Code;
+
+  constexpr auto kMaxPgmValue = 255;
+
+  struct PgmHeader {
+    cv::Size size;
+    size_t pixels_offset;
+  };
+
+  auto IsPgmSpace(const uint8_t c) noexcept -> bool {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+           c == '\f';
+  }
+
+  // Reads the header of the binary PGM |data|: the magic number, then the
+  // width, the height and the maximum value as decimal numbers separated
+  // by spaces and '#' comments, then one space before the pixels
+  auto ParsePgmHeader(const uint8_t* data,
+                      const size_t size,
+                      const std::string& path) -> PgmHeader {
+    const auto raise = [&path]() {
+      CV_Error(ErrorCode::StsBadArg,
+               fmt::format("{} is not an 8-bit binary PGM image", path));
+    };
+
+    if (size < 2 || data[0] != 'P' || data[1] != '5') {
+      raise();
+    }
+
+    size_t position = 2;
+    const auto read_number = [&data, &size, &position, &raise]() {
+      while (position < size) {
+        if (data[position] == '#') {
+          while (position < size && data[position] != '\n') {
+            ++position;
+          }
+        }
+        else if (IsPgmSpace(data[position])) {
+          ++position;
+        }
+        else {
+          break;
+        }
+      }
+
+      auto number = 0;
+      auto digits = 0;
+      for (; position < size && data[position] >= '0' &&
+             data[position] <= '9' && digits < 9;
+           ++position, ++digits) {
+        number = number * 10 + (data[position] - '0');
+      }
+      if (digits == 0) {
+        raise();
+      }
+      return number;
+    };
+
+    const auto width     = read_number();
+    const auto height    = read_number();
+    const auto max_value = read_number();
+    if (width == 0 || height == 0 || max_value == 0 ||
+        max_value > kMaxPgmValue || position >= size ||
+        !IsPgmSpace(data[position])) {
+      raise();
+    }
+    return {cv::Size{width, height}, position + 1};
+  }
+
+  // Header over the |size| pixels of |file| from |offset|
+  auto MakeImageHeader(const MappedFile& file,
+                       const cv::Size& size,
+                       const size_t offset,
+                       const std::string& path) -> cv::Mat {
+    const auto pixel_count =
+      static_cast<size_t>(size.width) * static_cast<size_t>(size.height);
+    if (offset > file.size() || file.size() - offset < pixel_count) {
+      CV_Error(ErrorCode::StsBadArg,
+               fmt::format("{} is smaller than a {}x{} image",
+                           path,
+                           size.width,
+                           size.height));
+    }
+    return {size, CV_8UC1, file.data() + offset};
+  }
+}   // namespace
+
+MappedImageReader::MappedImageReader(const std::string& path) :
+  file_{path} {
+  const auto header = ParsePgmHeader(file_.data(), file_.size(), path);
+  image_ = MakeImageHeader(file_, header.size, header.pixels_offset, path);
+  file_.AdviseSequential();
+}
+
+MappedImageReader::MappedImageReader(const std::string& path,
+                                     const cv::Size& size,
+                                     const size_t offset) :
+  file_{path} {
+  // pre-conditions
+  if (size.empty()) {
+    CV_Error(ErrorCode::StsBadArg, "image size is empty");
+  }
+
+  image_ = MakeImageHeader(file_, size, offset, path);
+  file_.AdviseSequential();
+}
+
+MappedImageWriter::MappedImageWriter(const std::string& path,
+                                     const cv::Size& size,
+                                     const MappedImageFormat format) :
+  size_{size} {
+  // pre-conditions
+  if (size.empty()) {
+    CV_Error(ErrorCode::StsBadArg, "image size is empty");
+  }
+
+  const auto header =
+    format == MappedImageFormat::kPgm
+      ? fmt::format("P5\n{} {}\n{}\n", size.width, size.height, kMaxPgmValue)
+      : std::string{};
+
+  const auto pixel_count =
+    static_cast<size_t>(size.width) * static_cast<size_t>(size.height);
+  file_ = MappedFile{path, header.size() + pixel_count};
+  std::copy(header.begin(), header.end(), file_.data());
+
+  pixels_ = file_.data() + header.size();
+  image_  = cv::Mat{size, CV_8UC1, pixels_};
+  file_.AdviseSequential();
+}
+
+void MappedImageWriter::Flush() const {
+  // pre-conditions
+  if (!is_mapped()) {
+    CV_Error(ErrorCode::StsError,
+             "image was reallocated, it is not written to the file");
+  }
+
+  file_.Flush();
+}
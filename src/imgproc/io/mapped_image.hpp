@@ -0,0 +1,87 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_IO_MAPPED_IMAGE_HPP_
+#define IMGPROC_IO_MAPPED_IMAGE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/io/mapped_file.hpp"
+
+namespace longlp::imgproc {
+
+  enum class MappedImageFormat : uint8_t {
+    // binary PGM (P5) with a maximum value of 255
+    kPgm,
+
+    // headerless 8-bit pixels, row after row
+    kRaw,
+  };
+
+  // 8-bit, single channel image read in place from a memory-mapped PGM or
+  // raw file: image() is a cv::Mat header over the pixels of the mapping,
+  // nothing is decoded nor copied. Pages are only read as rows are
+  // touched, with a sequential read-ahead hint.
+  class MappedImageReader {
+   public:
+    // Maps the binary PGM file |path|
+    explicit MappedImageReader(const std::string& path);
+
+    // Maps the raw file |path| holding |size| pixels from |offset|
+    MappedImageReader(const std::string& path,
+                      const cv::Size& size,
+                      size_t offset = 0);
+
+    // Valid as long as the reader, its pixels must not be written
+    [[nodiscard]] auto image() const noexcept -> const cv::Mat& {
+      return image_;
+    }
+
+   private:
+    MappedFile file_;
+    cv::Mat image_;
+  };
+
+  // 8-bit, single channel image written in place to a memory-mapped PGM or
+  // raw file: image() is a cv::Mat header over the pixels of the mapping,
+  // to be given as the output of BinarizationAlgorithm::Binarize, which
+  // keeps an output of the input size and type. The kernel writes the
+  // pages back, Flush() waits for it.
+  class MappedImageWriter {
+   public:
+    // Creates |path|, or truncates it, holding a |size| image in |format|
+    MappedImageWriter(const std::string& path,
+                      const cv::Size& size,
+                      MappedImageFormat format = MappedImageFormat::kPgm);
+
+    // Valid as long as the writer, it must not be reallocated
+    [[nodiscard]] auto image() noexcept -> cv::Mat& {
+      return image_;
+    }
+
+    // Whether image() still refers to the mapped pixels
+    [[nodiscard]] auto is_mapped() const noexcept -> bool {
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      return image_.data == pixels_ && image_.size() == size_ &&
+             image_.type() == CV_8UC1;
+    }
+
+    // Writes the pixels back to the file before returning, image() must
+    // still be mapped
+    void Flush() const;
+
+   private:
+    MappedFile file_;
+    cv::Size size_;
+    uint8_t* pixels_{nullptr};
+    cv::Mat image_;
+  };
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_IO_MAPPED_IMAGE_HPP_
@@ -0,0 +1,67 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/io/pbm_writer.hpp"
+
+#include <fstream>
+
+#include <fmt/format.h>
+
+namespace {
+  using longlp::imgproc::PackedBinaryImage;
+  using longlp::imgproc::PbmWriter;
+
+  using ErrorCode = cv::Error::Code;
+
+  void CheckStream(const std::ostream& stream) {
+    if (!stream) {
+      CV_Error(ErrorCode::StsError, "cannot write the PBM stream");
+    }
+  }
+}   // namespace
+
+PbmWriter::PbmWriter(std::ostream& stream, const cv::Size& size) :
+  stream_{stream},
+  size_{size} {
+  // pre-conditions
+  if (size.empty()) {
+    CV_Error(ErrorCode::StsBadArg, "image size is empty");
+  }
+
+  stream_ << fmt::format("P4\n{} {}\n", size.width, size.height);
+  CheckStream(stream_);
+}
+
+void PbmWriter::WriteRow(const uint8_t* packed_row) {
+  // pre-conditions
+  if (rows_written_ >= size_.height) {
+    CV_Error(ErrorCode::StsOutOfRange, "every row is already written");
+  }
+
+  stream_.write(reinterpret_cast<const char*>(packed_row),
+                (size_.width + 7) / 8);
+  CheckStream(stream_);
+  ++rows_written_;
+}
+
+void PbmWriter::Write(const PackedBinaryImage& image) {
+  // pre-conditions
+  if (image.size() != size_) {
+    CV_Error(ErrorCode::StsBadArg, "image does not have the writer size");
+  }
+
+  for (auto y = 0; y < size_.height; ++y) {
+    WriteRow(image.bytes(y));
+  }
+}
+
+void longlp::imgproc::WritePbm(const std::string& path,
+                               const PackedBinaryImage& image) {
+  std::ofstream file{path, std::ios::binary};
+  if (!file) {
+    CV_Error(ErrorCode::StsError, fmt::format("cannot open {}", path));
+  }
+
+  PbmWriter{file, image.size()}.Write(image);
+}
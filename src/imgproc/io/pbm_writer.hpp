@@ -0,0 +1,48 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_IO_PBM_WRITER_HPP_
+#define IMGPROC_IO_PBM_WRITER_HPP_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/packed_binary_image.hpp"
+
+namespace longlp::imgproc {
+
+  // Streaming writer of binary PBM (P4) images. Rows are written to the
+  // stream as they are given, packed as the rows of PackedBinaryImage, which
+  // already are PBM rows: 1 for black, MSB-first, padded to whole bytes.
+  class PbmWriter {
+   public:
+    // Writes the header of a |size| image to |stream|, which must outlive
+    // the writer
+    PbmWriter(std::ostream& stream, const cv::Size& size);
+
+    // Writes the next row, the (width + 7) / 8 bytes of |packed_row|
+    void WriteRow(const uint8_t* packed_row);
+
+    // Writes every row of |image|, of the size of the writer
+    void Write(const PackedBinaryImage& image);
+
+    [[nodiscard]] auto rows_written() const noexcept -> int {
+      return rows_written_;
+    }
+
+   private:
+    std::ostream& stream_;
+    cv::Size size_;
+    int rows_written_{0};
+  };
+
+  // Writes |image| to the PBM file |path|
+  void WritePbm(const std::string& path, const PackedBinaryImage& image);
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_IO_PBM_WRITER_HPP_
@@ -0,0 +1,375 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#include "imgproc/io/tiff_g4_writer.hpp"
+
+#include <algorithm>   // std::max
+#include <array>
+#include <bit>         // std::countl_zero
+#include <cstdlib>     // std::abs
+#include <fstream>
+#include <limits>
+#include <utility>     // std::swap
+
+#include <fmt/format.h>
+
+namespace {
+  using longlp::imgproc::PackedBinaryImage;
+  using longlp::imgproc::TiffG4Writer;
+
+  using ErrorCode = cv::Error::Code;
+
+  // T.4 / T.6 code words, |length| bits from the LSB of |bits|
+  struct Code {
+    uint16_t bits;
+    int length;
+  };
+
+  // Runs of 0 to 63 pixels
+  constexpr std::array<Code, 64> kWhiteTerminatingCodes{{
+    {0b00110101, 8}, {0b000111, 6}, {0b0111, 4}, {0b1000, 4}, {0b1011, 4},
+    {0b1100, 4}, {0b1110, 4}, {0b1111, 4}, {0b10011, 5}, {0b10100, 5},
+    {0b00111, 5}, {0b01000, 5}, {0b001000, 6}, {0b000011, 6}, {0b110100, 6},
+    {0b110101, 6}, {0b101010, 6}, {0b101011, 6}, {0b0100111, 7}, {0b0001100, 7},
+    {0b0001000, 7}, {0b0010111, 7}, {0b0000011, 7}, {0b0000100, 7},
+    {0b0101000, 7}, {0b0101011, 7}, {0b0010011, 7}, {0b0100100, 7},
+    {0b0011000, 7}, {0b00000010, 8}, {0b00000011, 8}, {0b00011010, 8},
+    {0b00011011, 8}, {0b00010010, 8}, {0b00010011, 8}, {0b00010100, 8},
+    {0b00010101, 8}, {0b00010110, 8}, {0b00010111, 8}, {0b00101000, 8},
+    {0b00101001, 8}, {0b00101010, 8}, {0b00101011, 8}, {0b00101100, 8},
+    {0b00101101, 8}, {0b00000100, 8}, {0b00000101, 8}, {0b00001010, 8},
+    {0b00001011, 8}, {0b01010010, 8}, {0b01010011, 8}, {0b01010100, 8},
+    {0b01010101, 8}, {0b00100100, 8}, {0b00100101, 8}, {0b01011000, 8},
+    {0b01011001, 8}, {0b01011010, 8}, {0b01011011, 8}, {0b01001010, 8},
+    {0b01001011, 8}, {0b00110010, 8}, {0b00110011, 8}, {0b00110100, 8}
+  }};
+
+  constexpr std::array<Code, 64> kBlackTerminatingCodes{{
+    {0b0000110111, 10}, {0b010, 3}, {0b11, 2}, {0b10, 2}, {0b011, 3},
+    {0b0011, 4}, {0b0010, 4}, {0b00011, 5}, {0b000101, 6}, {0b000100, 6},
+    {0b0000100, 7}, {0b0000101, 7}, {0b0000111, 7}, {0b00000100, 8},
+    {0b00000111, 8}, {0b000011000, 9}, {0b0000010111, 10}, {0b0000011000, 10},
+    {0b0000001000, 10}, {0b00001100111, 11}, {0b00001101000, 11},
+    {0b00001101100, 11}, {0b00000110111, 11}, {0b00000101000, 11},
+    {0b00000010111, 11}, {0b00000011000, 11}, {0b000011001010, 12},
+    {0b000011001011, 12}, {0b000011001100, 12}, {0b000011001101, 12},
+    {0b000001101000, 12}, {0b000001101001, 12}, {0b000001101010, 12},
+    {0b000001101011, 12}, {0b000011010010, 12}, {0b000011010011, 12},
+    {0b000011010100, 12}, {0b000011010101, 12}, {0b000011010110, 12},
+    {0b000011010111, 12}, {0b000001101100, 12}, {0b000001101101, 12},
+    {0b000011011010, 12}, {0b000011011011, 12}, {0b000001010100, 12},
+    {0b000001010101, 12}, {0b000001010110, 12}, {0b000001010111, 12},
+    {0b000001100100, 12}, {0b000001100101, 12}, {0b000001010010, 12},
+    {0b000001010011, 12}, {0b000000100100, 12}, {0b000000110111, 12},
+    {0b000000111000, 12}, {0b000000100111, 12}, {0b000000101000, 12},
+    {0b000001011000, 12}, {0b000001011001, 12}, {0b000000101011, 12},
+    {0b000000101100, 12}, {0b000001011010, 12}, {0b000001100110, 12},
+    {0b000001100111, 12}
+  }};
+
+  // Runs of 64 i pixels, the codes from 1792 are shared by both colors
+  constexpr std::array<Code, 41> kWhiteMakeupCodes{{
+    {0, 0}, {0b11011, 5}, {0b10010, 5}, {0b010111, 6}, {0b0110111, 7},
+    {0b00110110, 8}, {0b00110111, 8}, {0b01100100, 8}, {0b01100101, 8},
+    {0b01101000, 8}, {0b01100111, 8}, {0b011001100, 9}, {0b011001101, 9},
+    {0b011010010, 9}, {0b011010011, 9}, {0b011010100, 9}, {0b011010101, 9},
+    {0b011010110, 9}, {0b011010111, 9}, {0b011011000, 9}, {0b011011001, 9},
+    {0b011011010, 9}, {0b011011011, 9}, {0b010011000, 9}, {0b010011001, 9},
+    {0b010011010, 9}, {0b011000, 6}, {0b010011011, 9}, {0b00000001000, 11},
+    {0b00000001100, 11}, {0b00000001101, 11}, {0b000000010010, 12},
+    {0b000000010011, 12}, {0b000000010100, 12}, {0b000000010101, 12},
+    {0b000000010110, 12}, {0b000000010111, 12}, {0b000000011100, 12},
+    {0b000000011101, 12}, {0b000000011110, 12}, {0b000000011111, 12}
+  }};
+
+  constexpr std::array<Code, 41> kBlackMakeupCodes{{
+    {0, 0}, {0b0000001111, 10}, {0b000011001000, 12}, {0b000011001001, 12},
+    {0b000001011011, 12}, {0b000000110011, 12}, {0b000000110100, 12},
+    {0b000000110101, 12}, {0b0000001101100, 13}, {0b0000001101101, 13},
+    {0b0000001001010, 13}, {0b0000001001011, 13}, {0b0000001001100, 13},
+    {0b0000001001101, 13}, {0b0000001110010, 13}, {0b0000001110011, 13},
+    {0b0000001110100, 13}, {0b0000001110101, 13}, {0b0000001110110, 13},
+    {0b0000001110111, 13}, {0b0000001010010, 13}, {0b0000001010011, 13},
+    {0b0000001010100, 13}, {0b0000001010101, 13}, {0b0000001011010, 13},
+    {0b0000001011011, 13}, {0b0000001100100, 13}, {0b0000001100101, 13},
+    {0b00000001000, 11}, {0b00000001100, 11}, {0b00000001101, 11},
+    {0b000000010010, 12}, {0b000000010011, 12}, {0b000000010100, 12},
+    {0b000000010101, 12}, {0b000000010110, 12}, {0b000000010111, 12},
+    {0b000000011100, 12}, {0b000000011101, 12}, {0b000000011110, 12},
+    {0b000000011111, 12}
+  }};
+
+  constexpr Code kPassCode{0b0001, 4};
+  constexpr Code kHorizontalCode{0b001, 3};
+  constexpr Code kEndOfLineCode{0b000000000001, 12};
+
+  // Vertical codes of a1 - b1 in [-3, 3]
+  constexpr std::array<Code, 7> kVerticalCodes{{
+    {0b0000010, 7}, {0b000010, 6}, {0b010, 3}, {0b1, 1}, {0b011, 3},
+    {0b000011, 6}, {0b0000011, 7}
+  }};
+
+  constexpr auto kMaxVerticalDistance = 3;
+
+  // Longest run coded by one makeup code, and longest run left after it
+  constexpr auto kLongestMakeupRun = 2560;
+  constexpr auto kLongestRun = kLongestMakeupRun + 63;
+
+  enum TiffType : uint16_t {
+    kShort    = 3,
+    kLong     = 4,
+    kRational = 5,
+  };
+
+  // Size of the TIFF header and of one directory entry
+  constexpr uint32_t kHeaderSize = 8;
+  constexpr uint32_t kEntrySize  = 12;
+
+  void AppendLittleEndian(std::vector<uint8_t>& bytes,
+                          const uint32_t value,
+                          const int size) {
+    for (auto i = 0; i < size; ++i) {
+      bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  void AppendEntry(std::vector<uint8_t>& bytes,
+                   const uint16_t tag,
+                   const TiffType type,
+                   const uint32_t value) {
+    AppendLittleEndian(bytes, tag, 2);
+    AppendLittleEndian(bytes, type, 2);
+    AppendLittleEndian(bytes, 1, 4);
+    // a SHORT value is left-justified in the 4 bytes of the entry
+    AppendLittleEndian(bytes, value, type == kShort ? 2 : 4);
+    if (type == kShort) {
+      AppendLittleEndian(bytes, 0, 2);
+    }
+  }
+
+  // Appends the columns where the color of |packed_row| changes, with the
+  // color left of the row white
+  void FindChanges(const uint8_t* packed_row,
+                   const int width,
+                   std::vector<int>& changes) {
+    changes.clear();
+
+    uint32_t previous_bit = 0;
+    for (auto x = 0; x < width; x += 8) {
+      const uint32_t byte = packed_row[x / 8];
+
+      // bit 7 - i is set when the pixel x + i differs from its left one
+      auto transitions = (byte ^ (byte >> 1U | previous_bit << 7U)) & 0xFFU;
+      previous_bit     = byte & 1U;
+
+      while (transitions != 0) {
+        const auto column =
+          x + std::countl_zero(transitions) - (32 - 8);
+        if (column >= width) {
+          // a black last pixel followed by the 0 padding bits
+          break;
+        }
+        changes.push_back(column);
+        transitions &= ~(0x80U >> (column - x));
+      }
+    }
+  }
+
+  // i-th change of |changes|, or |width| past the last one
+  auto GetChange(const std::vector<int>& changes,
+                 const size_t i,
+                 const int width) noexcept -> int {
+    return i < changes.size() ? changes[i] : width;
+  }
+}   // namespace
+
+TiffG4Writer::TiffG4Writer(std::ostream& stream,
+                           const cv::Size& size,
+                           const int dpi) :
+  stream_{stream},
+  size_{size},
+  dpi_{dpi} {
+  // pre-conditions
+  if (size.empty()) {
+    CV_Error(ErrorCode::StsBadArg, "image size is empty");
+  }
+  if (dpi <= 0) {
+    CV_Error(ErrorCode::StsBadArg, "resolution must be positive");
+  }
+
+  reference_changes_.reserve(static_cast<size_t>(size.width));
+  coding_changes_.reserve(static_cast<size_t>(size.width));
+}
+
+void TiffG4Writer::PutBits(const uint32_t code, const int length) {
+  pending_bits_ = pending_bits_ << static_cast<uint32_t>(length) | code;
+  pending_bit_count_ += length;
+
+  while (pending_bit_count_ >= 8) {
+    pending_bit_count_ -= 8;
+    strip_.push_back(static_cast<uint8_t>(
+      pending_bits_ >> static_cast<uint32_t>(pending_bit_count_)));
+  }
+}
+
+void TiffG4Writer::PutRun(int run, const bool is_black) {
+  const auto& makeup_codes = is_black ? kBlackMakeupCodes : kWhiteMakeupCodes;
+  const auto& terminating_codes =
+    is_black ? kBlackTerminatingCodes : kWhiteTerminatingCodes;
+
+  for (; run > kLongestRun; run -= kLongestMakeupRun) {
+    const auto& code = makeup_codes.back();
+    PutBits(code.bits, code.length);
+  }
+  if (run >= 64) {
+    const auto& code = makeup_codes[static_cast<size_t>(run / 64)];
+    PutBits(code.bits, code.length);
+  }
+  const auto& code = terminating_codes[static_cast<size_t>(run % 64)];
+  PutBits(code.bits, code.length);
+}
+
+void TiffG4Writer::WriteRow(const uint8_t* packed_row) {
+  // pre-conditions
+  if (rows_written_ >= size_.height) {
+    CV_Error(ErrorCode::StsOutOfRange, "every row is already written");
+  }
+
+  const auto width = size_.width;
+  FindChanges(packed_row, width, coding_changes_);
+
+  // a0 is the last coded column, -1 before the row, b1 is the first change
+  // of the reference row right of a0 to the color opposite to a0's, the
+  // changes to black have even indices
+  auto a0       = -1;
+  auto is_black = false;
+  size_t a1_index = 0;
+  size_t b_index  = 0;
+  while (a0 < width) {
+    while (GetChange(coding_changes_, a1_index, width) <= a0) {
+      ++a1_index;
+    }
+    while (GetChange(reference_changes_, b_index, width) <= a0) {
+      ++b_index;
+    }
+    const auto b1_index = b_index + (b_index % 2 == (is_black ? 0 : 1));
+
+    const auto a1 = GetChange(coding_changes_, a1_index, width);
+    const auto b1 = GetChange(reference_changes_, b1_index, width);
+    const auto b2 = GetChange(reference_changes_, b1_index + 1, width);
+
+    if (b2 < a1) {
+      PutBits(kPassCode.bits, kPassCode.length);
+      a0 = b2;
+    }
+    else if (std::abs(a1 - b1) <= kMaxVerticalDistance) {
+      const auto& code =
+        kVerticalCodes[static_cast<size_t>(a1 - b1 + kMaxVerticalDistance)];
+      PutBits(code.bits, code.length);
+      a0       = a1;
+      is_black = !is_black;
+    }
+    else {
+      const auto a2 = GetChange(coding_changes_, a1_index + 1, width);
+      PutBits(kHorizontalCode.bits, kHorizontalCode.length);
+      PutRun(a1 - std::max(a0, 0), is_black);
+      PutRun(a2 - a1, !is_black);
+      a0 = a2;
+    }
+  }
+
+  std::swap(reference_changes_, coding_changes_);
+  ++rows_written_;
+}
+
+void TiffG4Writer::Write(const PackedBinaryImage& image) {
+  // pre-conditions
+  if (image.size() != size_) {
+    CV_Error(ErrorCode::StsBadArg, "image does not have the writer size");
+  }
+
+  for (auto y = 0; y < size_.height; ++y) {
+    WriteRow(image.bytes(y));
+  }
+}
+
+void TiffG4Writer::Finish() {
+  // pre-conditions
+  if (rows_written_ != size_.height) {
+    CV_Error(ErrorCode::StsError,
+             fmt::format("{} rows of {} are written",
+                         rows_written_,
+                         size_.height));
+  }
+
+  // end of facsimile block, then 0 bits up to the byte
+  PutBits(kEndOfLineCode.bits, kEndOfLineCode.length);
+  PutBits(kEndOfLineCode.bits, kEndOfLineCode.length);
+  if (pending_bit_count_ > 0) {
+    PutBits(0, 8 - pending_bit_count_);
+  }
+
+  // header, strip, then the directory on a word boundary followed by the
+  // resolutions
+  constexpr uint16_t kEntryCount = 12;
+  if (strip_.size() >
+      std::numeric_limits<uint32_t>::max() - kHeaderSize - 256) {
+    CV_Error(ErrorCode::StsOutOfRange, "compressed image exceeds 4 GB");
+  }
+  const auto strip_size = static_cast<uint32_t>(strip_.size());
+  const auto directory_offset = (kHeaderSize + strip_size + 1U) & ~1U;
+  const auto resolution_offset =
+    directory_offset + 2 + kEntryCount * kEntrySize + 4;
+
+  std::vector<uint8_t> header{'I', 'I'};
+  AppendLittleEndian(header, 42, 2);
+  AppendLittleEndian(header, directory_offset, 4);
+
+  std::vector<uint8_t> directory{};
+  if (directory_offset != kHeaderSize + strip_size) {
+    directory.push_back(0);
+  }
+  const auto width  = static_cast<uint32_t>(size_.width);
+  const auto height = static_cast<uint32_t>(size_.height);
+
+  AppendLittleEndian(directory, kEntryCount, 2);
+  AppendEntry(directory, 256, kLong, width);               // ImageWidth
+  AppendEntry(directory, 257, kLong, height);              // ImageLength
+  AppendEntry(directory, 258, kShort, 1);                  // BitsPerSample
+  AppendEntry(directory, 259, kShort, 4);                  // CCITT T.6
+  AppendEntry(directory, 262, kShort, 0);                  // WhiteIsZero
+  AppendEntry(directory, 273, kLong, kHeaderSize);         // StripOffsets
+  AppendEntry(directory, 277, kShort, 1);                  // SamplesPerPixel
+  AppendEntry(directory, 278, kLong, height);              // RowsPerStrip
+  AppendEntry(directory, 279, kLong, strip_size);          // StripByteCounts
+  AppendEntry(directory, 282, kRational, resolution_offset);   // XResolution
+  AppendEntry(directory, 283, kRational, resolution_offset);   // YResolution
+  AppendEntry(directory, 296, kShort, 2);                  // inches
+  AppendLittleEndian(directory, 0, 4);                     // no next IFD
+
+  AppendLittleEndian(directory, static_cast<uint32_t>(dpi_), 4);
+  AppendLittleEndian(directory, 1, 4);
+
+  stream_.write(reinterpret_cast<const char*>(header.data()),
+                static_cast<std::streamsize>(header.size()));
+  stream_.write(reinterpret_cast<const char*>(strip_.data()),
+                static_cast<std::streamsize>(strip_.size()));
+  stream_.write(reinterpret_cast<const char*>(directory.data()),
+                static_cast<std::streamsize>(directory.size()));
+  if (!stream_) {
+    CV_Error(ErrorCode::StsError, "cannot write the TIFF stream");
+  }
+}
+
+void longlp::imgproc::WriteTiffG4(const std::string& path,
+                                  const PackedBinaryImage& image) {
+  std::ofstream file{path, std::ios::binary};
+  if (!file) {
+    CV_Error(ErrorCode::StsError, fmt::format("cannot open {}", path));
+  }
+
+  TiffG4Writer writer{file, image.size()};
+  writer.Write(image);
+  writer.Finish();
+}
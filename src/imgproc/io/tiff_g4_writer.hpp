@@ -0,0 +1,66 @@
+// Copyright 2021 Long Le Phi. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+
+#ifndef IMGPROC_IO_TIFF_G4_WRITER_HPP_
+#define IMGPROC_IO_TIFF_G4_WRITER_HPP_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "imgproc/common/packed_binary_image.hpp"
+
+namespace longlp::imgproc {
+
+  // Streaming writer of bilevel TIFF images compressed with CCITT Group 4
+  // (T.6). Each row is coded against the changing elements of the previous
+  // one as it is given, so that only two rows of run boundaries are kept;
+  // the compressed strip is buffered until Finish() writes the file, as the
+  // TIFF directory needs its byte count.
+  class TiffG4Writer {
+   public:
+    // |stream| must outlive the writer, |dpi| is stored as the resolution
+    TiffG4Writer(std::ostream& stream, const cv::Size& size, int dpi = 300);
+
+    // Codes the next row, packed as the rows of PackedBinaryImage
+    void WriteRow(const uint8_t* packed_row);
+
+    // Codes every row of |image|, of the size of the writer
+    void Write(const PackedBinaryImage& image);
+
+    // Ends the strip once every row is coded and writes the TIFF file
+    void Finish();
+
+    [[nodiscard]] auto rows_written() const noexcept -> int {
+      return rows_written_;
+    }
+
+   private:
+    void PutBits(uint32_t code, int length);
+    void PutRun(int run, bool is_black);
+
+    std::ostream& stream_;
+    cv::Size size_;
+    int dpi_;
+    int rows_written_{0};
+
+    // columns where the color changes in the previous (reference) and the
+    // current (coding) rows, the first one is white to black
+    std::vector<int> reference_changes_;
+    std::vector<int> coding_changes_;
+
+    std::vector<uint8_t> strip_;
+    uint64_t pending_bits_{0};
+    int pending_bit_count_{0};
+  };
+
+  // Writes |image| to the TIFF G4 file |path|
+  void WriteTiffG4(const std::string& path, const PackedBinaryImage& image);
+
+}   // namespace longlp::imgproc
+
+#endif   // IMGPROC_IO_TIFF_G4_WRITER_HPP_